@@ -1,8 +1,12 @@
 from board import Board
 import random
 
+# Inside bin/rollerball_py, the `rollerball` module is also importable:
+# rollerball.searching() turns False once the server sends `stop` or the go
+# movetime runs out, and rollerball.set_best_move(move) records a move to play
+# if the search is cut short.
+
 def find_best_move(board):
-    print(board.get_legal_moves())
     moves = list(board.get_legal_moves())
     idx = random.randint(0, len(moves) - 1)
     return moves[idx]
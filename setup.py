@@ -1,13 +1,19 @@
+import os
 from pathlib import Path
 
 from pybind11.setup_helpers import Pybind11Extension, build_ext
 from setuptools import setup
 
+extra_compile_args = ['-O3', '-DASIO_STANDALONE']
+# AVX2=1, as for the Makefile
+if os.environ.get('AVX2'):
+    extra_compile_args.append('-mavx2')
+
 board_module = Pybind11Extension(
     'board',
-    ['src/board.cpp', 'src/bindings.cpp'],
+    ['src/board.cpp', 'src/book.cpp', 'src/engine.cpp', 'src/engine_common.cpp', 'src/mate.cpp', 'src/mcts.cpp', 'src/nnue.cpp', 'src/tablebase.cpp', 'src/tt.cpp', 'src/bindings.cpp'],
     include_dirs=['include'],
-    extra_compile_args=['-O3', '-DASIO_STANDALONE']
+    extra_compile_args=extra_compile_args
 )
 
 setup(
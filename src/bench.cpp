@@ -0,0 +1,30 @@
+#include "bench.hpp"
+
+const std::vector<BenchPosition>& bench_positions() {
+    static const std::vector<BenchPosition> positions = {
+        {"opening", ""},
+        {"middlegame",
+         "c2b3 e6f7 c1b2 d7e2 d1c2 e2d1 c2d1 c6b6 b3b4 b6a6 b2b3 f7g6 b3a4 g6g5 a4b5"},
+        {"in_check",
+         "c2b3 e6f7 c1b2 d7e2 d1c2 e2d1 c2d1 c6b6 b3b4 b6a6 b2b3 f7g6 b3a4 g6g5 a4b5 "
+         "g5g4 d2c1 d6d7 b5a6"},
+        {"endgame",
+         "c2b3 e6f7 c1b2 d7e2 d1c2 e2d1 c2d1 c6b6 b3b4 b6a6 b2b3 f7g6 b3a4 g6g5 a4b5 "
+         "g5g4 d2c1 d6d7 b5a6 d7e6 d1b5 c7d7 b5d7 e6d7 e1d1 g4g3 d1d2 d7e6 d2a2 e6f7 "
+         "b4b5 f7g7 b5c6 g7g6 c6d6 e7f7 d6e7r g3g2 e7d7 g2g1 a6b7 f7g7 b7c6 g6g5 d7g7 "
+         "g5f6 g7g1 f6f5"},
+    };
+    return positions;
+}
+
+Board play_moves(std::string_view moves) {
+
+    Board b;
+    while (!moves.empty()) {
+        size_t end = moves.find(' ');
+        if (end == std::string_view::npos) end = moves.size();
+        if (end > 0) b.do_move(str_to_move(moves.substr(0, end)));
+        moves.remove_prefix(end == moves.size() ? end : end + 1);
+    }
+    return b;
+}
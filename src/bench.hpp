@@ -0,0 +1,22 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <string_view>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Representative positions for benchmarks, each given by the moves that
+// reach it from the start position, so they stay valid whatever the board
+// representation
+struct BenchPosition {
+    const char *name;
+    const char *moves;
+};
+
+const std::vector<BenchPosition>& bench_positions();
+
+// Plays space separated moves from the start position
+Board play_moves(std::string_view moves);
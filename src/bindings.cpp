@@ -1,13 +1,225 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
+#include <thread>
 #include "board.hpp"
+#include "engine.hpp"
+#include "nnue.hpp"
 
 namespace py = pybind11;
 
+// one 7x7 plane per (color, piece type): white pawn, rook, king, bishop,
+// then black in the same order
+const int N_PLANES = 8;
+
+void encode_board(const Board& b, U8 *planes) {
+
+    std::fill(planes, planes + N_PLANES*49, 0);
+
+    for (int y=0; y<7; y++) {
+        for (int x=0; x<7; x++) {
+            U8 piece = b.data.board_0[pos(x,y)];
+            if (!piece) continue;
+
+            int plane = (piece & WHITE) ? 0 : 4;
+            if      (piece & ROOK)   plane += 1;
+            else if (piece & KING)   plane += 2;
+            else if (piece & BISHOP) plane += 3;
+
+            planes[plane*49 + y*7 + x] = 1;
+        }
+    }
+}
+
+// The batch functions below take a list of boards, convert it once, and then
+// do all the work with the GIL released. Boards must not be modified from
+// another thread while a batch call is running.
+
+py::tuple batch_legal_moves(const std::vector<const Board*>& boards) {
+
+    // flattened moves, with the moves of boards[i] in moves[offsets[i]:offsets[i+1]]
+    std::vector<U16> moves;
+    std::vector<int64_t> offsets(boards.size() + 1, 0);
+    {
+        py::gil_scoped_release release;
+        for (size_t i=0; i<boards.size(); i++) {
+            auto legal_moves = boards[i]->get_sorted_legal_moves();
+            moves.insert(moves.end(), legal_moves.begin(), legal_moves.end());
+            offsets[i+1] = moves.size();
+        }
+    }
+
+    py::array_t<U16> moves_arr(moves.size());
+    py::array_t<int64_t> offsets_arr(offsets.size());
+    std::copy(moves.begin(), moves.end(), moves_arr.mutable_data());
+    std::copy(offsets.begin(), offsets.end(), offsets_arr.mutable_data());
+
+    return py::make_tuple(moves_arr, offsets_arr);
+}
+
+py::array_t<int32_t> batch_evaluate(const std::vector<const Board*>& boards) {
+
+    py::array_t<int32_t> scores(boards.size());
+    int32_t *out = scores.mutable_data();
+    {
+        py::gil_scoped_release release;
+        for (size_t i=0; i<boards.size(); i++) {
+            out[i] = evaluate(*boards[i]);
+        }
+    }
+    return scores;
+}
+
+py::array_t<U64> batch_hash(const std::vector<const Board*>& boards) {
+
+    py::array_t<U64> hashes(boards.size());
+    U64 *out = hashes.mutable_data();
+    {
+        py::gil_scoped_release release;
+        for (size_t i=0; i<boards.size(); i++) {
+            out[i] = boards[i]->hash();
+        }
+    }
+    return hashes;
+}
+
+py::array_t<U8> batch_encode(const std::vector<const Board*>& boards) {
+
+    py::array_t<U8> planes({(py::ssize_t)boards.size(), (py::ssize_t)N_PLANES, (py::ssize_t)7, (py::ssize_t)7});
+    U8 *out = planes.mutable_data();
+    {
+        py::gil_scoped_release release;
+        for (size_t i=0; i<boards.size(); i++) {
+            encode_board(*boards[i], out + i*N_PLANES*49);
+        }
+    }
+    return planes;
+}
+
+// Plays each move sequence from b, returning one new board per sequence
+std::vector<Board> apply_sequences(const Board& b, const std::vector<std::vector<U16>>& sequences) {
+
+    std::vector<Board> boards(sequences.size(), b);
+    {
+        py::gil_scoped_release release;
+        for (size_t i=0; i<sequences.size(); i++) {
+            for (U16 m : sequences[i]) {
+                boards[i].do_move(m);
+            }
+        }
+    }
+    return boards;
+}
+
+// Searches b with the native engine, with the GIL released so that another
+// Python thread can call Engine.stop() while it runs
+py::dict engine_search(Engine& e, const Board& b, int depth, int nodes, int movetime, int mate) {
+
+    e.limits.depth = depth;
+    e.limits.nodes = nodes;
+    e.limits.movetime_ms = movetime;
+    e.limits.mate = mate;
+    e.search = true;
+    {
+        py::gil_scoped_release release;
+        e.find_best_move(b);
+    }
+
+    py::dict result;
+    result["best_move"] = (U16)e.best_move;
+    result["score"] = e.best_eval.total;
+    result["pv"] = e.pv;
+    result["depth"] = e.depth_reached;
+    result["nodes"] = e.nodes_visited;
+    result["evaluation"] = e.best_eval;
+
+    py::list lines;
+    for (auto& line : e.lines) {
+        py::dict d;
+        d["move"] = line.move;
+        d["score"] = line.score;
+        d["pv"] = line.pv;
+        lines.append(d);
+    }
+    result["lines"] = lines;
+    return result;
+}
+
 PYBIND11_MODULE(board, m) {
     py::class_<Board>(m, "Board")
+        .def(py::init<>())
         .def("get_legal_moves", &Board::get_legal_moves)
         .def("in_check", &Board::in_check)
         .def("copy", &Board::copy)
-        .def("do_move", &Board::do_move);
+        .def("do_move", &Board::do_move)
+        .def("hash", &Board::hash)
+        .def("canonical_hash", [](const Board& b) {
+            bool mirrored;
+            U64 key = b.canonical_hash(&mirrored);
+            return py::make_tuple(key, mirrored);
+        })
+        .def("mirror", &mirror_board)
+        .def("evaluate", &evaluate)
+        .def("encode", [](const Board& b) {
+            py::array_t<U8> planes({(py::ssize_t)N_PLANES, (py::ssize_t)7, (py::ssize_t)7});
+            encode_board(b, planes.mutable_data());
+            return planes;
+        })
+        .def("apply_sequences", &apply_sequences);
+
+    py::class_<Evaluation>(m, "Evaluation")
+        .def_readonly("piece_weight", &Evaluation::piece_weight)
+        .def_readonly("promo", &Evaluation::promo)
+        .def_readonly("check", &Evaluation::check)
+        .def_readonly("king_distance", &Evaluation::king_distance)
+        .def_readonly("depth", &Evaluation::depth)
+        .def_readonly("attack", &Evaluation::attack)
+        .def_readonly("ring_weight", &Evaluation::ring_weight)
+        .def_readonly("nnue", &Evaluation::nnue)
+        .def_readonly("tablebase", &Evaluation::tablebase)
+        .def_readonly("total", &Evaluation::total);
+
+    py::enum_<SearchBackend>(m, "SearchBackend")
+        .value("ALPHA_BETA", SEARCH_ALPHA_BETA)
+        .value("MCTS", SEARCH_MCTS);
+
+    py::enum_<MctsLeaf>(m, "MctsLeaf")
+        .value("EVAL", MCTS_EVAL)
+        .value("PLAYOUT", MCTS_PLAYOUT);
+
+    py::class_<Engine>(m, "Engine")
+        .def(py::init([]() {
+            Engine *e = new Engine();
+            e->verbose = false;
+            return e;
+        }))
+        .def("search", &engine_search, py::arg("board"), py::arg("depth") = 0, py::arg("nodes") = 0, py::arg("movetime") = 0, py::arg("mate") = 0)
+        .def("stop", [](Engine& e) { e.search = false; })
+        .def("new_game", [](Engine& e) {
+            e.previous_board_occurences.clear();
+            if (!e.tt.is_shared()) {
+                e.tt.clear(std::thread::hardware_concurrency());
+            }
+            e.mate_solver.clear();
+        })
+        .def_readwrite("verbose", &Engine::verbose)
+        .def_readwrite("use_nnue", &Engine::use_nnue)
+        .def_readwrite("hash_mb", &Engine::hash_mb)
+        .def_readwrite("mate_check", &Engine::mate_check)
+        .def_readwrite("mate_hash_mb", &Engine::mate_hash_mb)
+        .def_readwrite("multi_pv", &Engine::multi_pv)
+        .def_readwrite("backend", &Engine::backend)
+        .def_property("mcts_leaf", [](const Engine& e) { return e.mcts.leaf; }, [](Engine& e, MctsLeaf leaf) { e.mcts.leaf = leaf; })
+        .def_property("mcts_threads", [](const Engine& e) { return e.mcts.threads; }, [](Engine& e, int n) { e.mcts.threads = std::max(n, 1); })
+        .def("save_tt", &Engine::save_tt, py::arg("path"))
+        .def("load_tt", &Engine::load_tt, py::arg("path"))
+        .def("attach_tt", &Engine::attach_tt, py::arg("name"))
+        .def("detach_tt", [](Engine& e) { e.tt.detach(); });
+
+    m.def("batch_legal_moves", &batch_legal_moves);
+    m.def("batch_evaluate", &batch_evaluate);
+    m.def("batch_hash", &batch_hash);
+    m.def("batch_encode", &batch_encode);
+    m.def("load_nnue", &nnue_load);
+    m.def("mirror_move", &mirror_move);
 }
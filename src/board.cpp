@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include "board.hpp"
@@ -55,6 +56,38 @@ constexpr U8 id[64] = {
 #define cw_180_move(p) move_promo(cw_180[getp0(m)], cw_180[getp1(m)], getpromo(m))
 #define color(p) ((PlayerColor)(p & (WHITE | BLACK)))
 
+// Zobrist keys for the 8 (color, piece type) pairs on each square, plus one
+// for black to play. Generated at compile time with splitmix64 so that hashes
+// are identical across builds and hosts.
+struct ZobristKeys {
+    U64 pieces[8][64];
+    U64 black_to_play;
+};
+
+constexpr U64 splitmix64(U64& state) {
+    U64 z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys make_zobrist_keys() {
+    ZobristKeys keys{};
+    U64 state = 0x526f6c6c657262ULL;
+    for (int i=0; i<8; i++) {
+        for (int p=0; p<64; p++) {
+            keys.pieces[i][p] = splitmix64(state);
+        }
+    }
+    keys.black_to_play = splitmix64(state);
+    return keys;
+}
+
+constexpr ZobristKeys zobrist = make_zobrist_keys();
+
+// 0-3 for pawn, rook, king, bishop; +4 for white
+#define piece_idx(p) (__builtin_ctz((p) & (PAWN | ROOK | KING | BISHOP)) - 1 + (((p) & WHITE) ? 4 : 0))
+
 std::unordered_set<U16> transform_moves(const std::unordered_set<U16>& moves, const U8 *transform) {
 
     std::unordered_set<U16> rot_moves;
@@ -66,10 +99,10 @@ std::unordered_set<U16> transform_moves(const std::unordered_set<U16>& moves, co
     return rot_moves;
 }
 
+template <PlayerColor color>
 std::unordered_set<U16> construct_bottom_rook_moves_with_board(const U8 p0, const U8* board) {
 
     int left_rook_reflect[7] = {0, 8, 16, 24, 32, 40, 48};
-    PlayerColor color = color(board[p0]);
     std::unordered_set<U16> rook_moves;
     bool refl_blocked = false;
 
@@ -126,9 +159,9 @@ std::unordered_set<U16> construct_bottom_rook_moves_with_board(const U8 p0, cons
     return rook_moves;
 }
 
+template <PlayerColor color>
 std::unordered_set<U16> construct_bottom_bishop_moves_with_board(const U8 p0, const U8* board) {
 
-    PlayerColor color = color(board[p0]);
     std::unordered_set<U16> bishop_moves;
 
     // top right - move back
@@ -219,9 +252,9 @@ std::unordered_set<U16> construct_bottom_bishop_moves_with_board(const U8 p0, co
     return bishop_moves;
 }
 
+template <PlayerColor color>
 std::unordered_set<U16> construct_bottom_pawn_moves_with_board(const U8 p0, const U8 *board, bool promote = false) {
     
-    PlayerColor color = color(board[p0]);
     std::unordered_set<U16> pawn_moves;
 
     if (!(board[pos(getx(p0)-1,0)] & color)) {
@@ -247,12 +280,12 @@ std::unordered_set<U16> construct_bottom_pawn_moves_with_board(const U8 p0, cons
     return pawn_moves;
 }
 
+template <PlayerColor color>
 std::unordered_set<U16> construct_bottom_king_moves_with_board(const U8 p0, const U8 *board) {
 
     // king can't move into check. See if these squares are under threat from 
     // enemy pieces as well.
     
-    PlayerColor color = color(board[p0]);
     std::unordered_set<U16> king_moves;
     if (!(board[pos(getx(p0)-1,0)] & color)) king_moves.insert(move(p0, pos(getx(p0)-1,0)));
     if (!(board[pos(getx(p0)-1,1)] & color)) king_moves.insert(move(p0, pos(getx(p0)-1,1)));
@@ -341,7 +374,7 @@ std::string move_to_str(U16 move) {
     return s;
 }
 
-U16 str_to_move(std::string move) {
+U16 str_to_move(std::string_view move) {
     
     U8 x0 = move[0] - 'a';
     U8 y0 = move[1] - '1';
@@ -356,8 +389,13 @@ U16 str_to_move(std::string move) {
     return move_promo(pos(x0,y0), pos(x1,y1), promo);
 }
 
+template <PlayerColor color>
 std::unordered_set<U16> Board::_get_pseudolegal_moves_for_piece(U8 piece_pos) const {
 
+    // a pawn of color on these squares promotes with its next move
+    constexpr U8 promo_from_0 = (color == WHITE ? 51 : 11);
+    constexpr U8 promo_from_1 = (color == WHITE ? 43 : 3);
+
     std::unordered_set<U16> moves;
     U8 piece_id = this->data.board_0[piece_pos];
 
@@ -374,22 +412,21 @@ std::unordered_set<U16> Board::_get_pseudolegal_moves_for_piece(U8 piece_pos) co
     else if (right.count(piece_pos)) { board = this->data.board_90; coord_map = cw_90;  inv_coord_map = acw_90; }
 
     if (piece_id & PAWN) {
-        if (((piece_pos == 51 || piece_pos == 43) && (piece_id & WHITE)) || 
-            ((piece_pos == 11 || piece_pos == 3)  && (piece_id & BLACK)) ) {
-            moves = construct_bottom_pawn_moves_with_board(coord_map[piece_pos], board, true);
+        if (piece_pos == promo_from_0 || piece_pos == promo_from_1) {
+            moves = construct_bottom_pawn_moves_with_board<color>(coord_map[piece_pos], board, true);
         }
         else {
-            moves = construct_bottom_pawn_moves_with_board(coord_map[piece_pos], board);
+            moves = construct_bottom_pawn_moves_with_board<color>(coord_map[piece_pos], board);
         }
     }
     else if (piece_id & ROOK) {
-        moves = construct_bottom_rook_moves_with_board(coord_map[piece_pos], board);
+        moves = construct_bottom_rook_moves_with_board<color>(coord_map[piece_pos], board);
     }
     else if (piece_id & BISHOP) {
-        moves = construct_bottom_bishop_moves_with_board(coord_map[piece_pos], board);
+        moves = construct_bottom_bishop_moves_with_board<color>(coord_map[piece_pos], board);
     }
     else if (piece_id & KING) {
-        moves = construct_bottom_king_moves_with_board(coord_map[piece_pos], board);
+        moves = construct_bottom_king_moves_with_board<color>(coord_map[piece_pos], board);
     }
 
     moves = transform_moves(moves, inv_coord_map);
@@ -426,12 +463,32 @@ Board::Board(): data{} {
 }
 
 
+Board board_from_pieces(const U8 *positions, const U8 *pieces, PlayerColor player_to_play) {
+
+    Board b;
+    memset(b.data.board_0, 0, sizeof(b.data.board_0));
+
+    U8 *piece_pos = (U8*)(&(b.data));
+    for (int i=0; i<12; i++) {
+        piece_pos[i] = positions[i];
+        if (positions[i] != DEAD) b.data.board_0[positions[i]] = pieces[i];
+    }
+    b.data.player_to_play = player_to_play;
+
+    rotate_board(b.data.board_0, b.data.board_90, cw_90);
+    rotate_board(b.data.board_0, b.data.board_180, cw_180);
+    rotate_board(b.data.board_0, b.data.board_270, acw_90);
+
+    return b;
+}
+
 // Optimization: generate inverse king moves
 // For now, just generate moves of the opposite color and check if any of them
 // attack the king square
+template <PlayerColor color>
 bool Board::_under_threat(U8 piece_pos) const {
 
-    auto pseudolegal_moves = this->_get_pseudolegal_moves_for_side(this->data.player_to_play ^ (WHITE | BLACK));
+    auto pseudolegal_moves = this->_get_pseudolegal_moves_for_side<opponent_of(color)>();
 
     for (auto move : pseudolegal_moves) {
         // std::cout << move_to_str(move) << " ";
@@ -445,37 +502,27 @@ bool Board::_under_threat(U8 piece_pos) const {
     return false;
 }
 
-bool Board::in_check() const {
-
-    auto king_pos = this->data.w_king;
-    // can make this branchless for kicks but won't add much performance
-    if (this->data.player_to_play == BLACK) {
-        king_pos = this->data.b_king;
-    }
-
-    return _under_threat(king_pos);
+template <PlayerColor color>
+bool Board::_in_check() const {
+    return _under_threat<color>(color == WHITE ? this->data.w_king : this->data.b_king);
 }
 
-std::unordered_set<U16> Board::_get_pseudolegal_moves() const {
-    return _get_pseudolegal_moves_for_side(this->data.player_to_play);
+bool Board::in_check() const {
+    return (this->data.player_to_play == WHITE ? _in_check<WHITE>() : _in_check<BLACK>());
 }
 
-std::unordered_set<U16> Board::_get_pseudolegal_moves_for_side(U8 color) const {
+template <PlayerColor color>
+std::unordered_set<U16> Board::_get_pseudolegal_moves_for_side() const {
 
-    // std::cout << "Getting Pseudolegal moves for " << (char)((color>>5) + 'a') << "\n";
     std::unordered_set<U16> pseudolegal_moves;
 
-    U8 *pieces = (U8*)(&(this->data));
-
-    if (color == WHITE) {
-        pieces = pieces + 6;
-    }
+    const U8 *pieces = (const U8*)(&(this->data)) + first_piece_slot(color);
 
     for (int i=0; i<6; i++) {
         //std::cout << "checking " << piece_to_char(this->data.board_0[pieces[i]]) << "\n";
         if (pieces[i] == DEAD) continue;
         //std::cout << "Getting Moves for " << piece_to_char(this->data.board_0[pieces[i]]) << "\n";
-        auto piece_moves = this->_get_pseudolegal_moves_for_piece(pieces[i]);
+        auto piece_moves = this->_get_pseudolegal_moves_for_piece<color>(pieces[i]);
         pseudolegal_moves.insert(piece_moves.begin(), piece_moves.end());
     }
 
@@ -483,6 +530,27 @@ std::unordered_set<U16> Board::_get_pseudolegal_moves_for_side(U8 color) const {
 
 }
 
+std::vector<U16> Board::get_attacks_on(U8 square) const {
+    return (this->data.player_to_play == WHITE ? _get_attacks_on<WHITE>(square) : _get_attacks_on<BLACK>(square));
+}
+
+template <PlayerColor color>
+std::vector<U16> Board::_get_attacks_on(U8 square) const {
+
+    std::vector<U16> attacks;
+
+    const U8 *pieces = (const U8*)(&(this->data)) + first_piece_slot(color);
+
+    for (int i=0; i<6; i++) {
+        if (pieces[i] == DEAD) continue;
+        for (auto move : this->_get_pseudolegal_moves_for_piece<color>(pieces[i])) {
+            if (getp1(move) == square) attacks.push_back(move);
+        }
+    }
+
+    return attacks;
+}
+
 Board* Board::copy() const {
 
     Board *b = new Board();
@@ -504,15 +572,26 @@ Board* Board::copy() const {
 //
 // Only implement the else case for now
 std::unordered_set<U16> Board::get_legal_moves() const {
+    return (this->data.player_to_play == WHITE ? _get_legal_moves<WHITE>() : _get_legal_moves<BLACK>());
+}
+
+std::vector<U16> Board::get_sorted_legal_moves() const {
+    return (this->data.player_to_play == WHITE ? _get_sorted_legal_moves<WHITE>() : _get_sorted_legal_moves<BLACK>());
+}
+
+// _do_move leaves the side to play as it was, so color is still the one
+// whose king must not be in check
+template <PlayerColor color>
+std::unordered_set<U16> Board::_get_legal_moves() const {
 
     Board* c = this->copy();
-    auto pseudolegal_moves = c->_get_pseudolegal_moves();
+    auto pseudolegal_moves = c->_get_pseudolegal_moves_for_side<color>();
     std::unordered_set<U16> legal_moves;
 
     for (auto move : pseudolegal_moves) {
         c->_do_move(move);
 
-        if (!c->in_check()) {
+        if (!c->_in_check<color>()) {
             legal_moves.insert(move);
         }
 
@@ -524,6 +603,80 @@ std::unordered_set<U16> Board::get_legal_moves() const {
     return legal_moves;
 }
 
+template <PlayerColor color>
+std::vector<U16> Board::_get_sorted_legal_moves() const {
+
+    Board* c = this->copy();
+    auto pseudolegal_moves = c->_get_pseudolegal_moves_for_side<color>();
+    std::vector<U16> sorted(pseudolegal_moves.begin(), pseudolegal_moves.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<U16> legal_moves;
+    for (auto move : sorted) {
+        c->_do_move(move);
+
+        if (!c->_in_check<color>()) {
+            legal_moves.push_back(move);
+        }
+
+        c->_undo_last_move(move);
+    }
+
+    delete c;
+
+    return legal_moves;
+}
+
+U64 Board::hash() const {
+
+    U64 h = (this->data.player_to_play == BLACK) ? zobrist.black_to_play : 0;
+
+    for (int p=0; p<56; p++) {
+        U8 piece = this->data.board_0[p];
+        if (piece) h ^= zobrist.pieces[piece_idx(piece)][p];
+    }
+
+    return h;
+}
+
+U64 Board::canonical_hash(bool *mirrored) const {
+
+    // the mirror image has each piece, of the other color, on the rotated
+    // square, and the other side to play
+    U64 h = (this->data.player_to_play == BLACK) ? zobrist.black_to_play : 0;
+    U64 mirror_h = (this->data.player_to_play == WHITE) ? zobrist.black_to_play : 0;
+
+    for (int p=0; p<56; p++) {
+        U8 piece = this->data.board_0[p];
+        if (piece) {
+            h ^= zobrist.pieces[piece_idx(piece)][p];
+            mirror_h ^= zobrist.pieces[piece_idx(piece) ^ 4][cw_180[p]];
+        }
+    }
+
+    if (mirrored) *mirrored = mirror_h < h;
+    return std::min(h, mirror_h);
+}
+
+Board mirror_board(const Board& b) {
+
+    const U8 *positions = (const U8*)(&(b.data));
+    U8 mirror_positions[12], mirror_pieces[12];
+
+    // black slots take the white pieces and the other way round
+    for (int i=0; i<12; i++) {
+        int j = (i + 6) % 12;
+        mirror_positions[i] = (positions[j] == DEAD) ? DEAD : cw_180[positions[j]];
+        mirror_pieces[i] = (positions[j] == DEAD) ? 0 : (b.data.board_0[positions[j]] ^ (WHITE | BLACK));
+    }
+
+    return board_from_pieces(mirror_positions, mirror_pieces, (PlayerColor)(b.data.player_to_play ^ (WHITE | BLACK)));
+}
+
+U16 mirror_move(U16 move) {
+    return move_promo(cw_180[getp0(move)], cw_180[getp1(move)], getpromo(move));
+}
+
 void Board::do_move(U16 move) {
     _do_move(move);
     _flip_player();
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_set>
 #include <stack>
 
 typedef uint8_t U8;
 typedef uint16_t U16;
+typedef uint64_t U64;
 
 #define pos(x,y) (((y)<<3)|(x))
 #define gety(p)  ((p)>>3)
@@ -24,6 +27,15 @@ enum PlayerColor {
     BLACK=(1<<5)
 };
 
+constexpr PlayerColor opponent_of(PlayerColor color) {
+    return (PlayerColor)(color ^ (WHITE | BLACK));
+}
+
+// index of the first of color's 6 piece squares in BoardData
+constexpr int first_piece_slot(PlayerColor color) {
+    return (color == WHITE ? 6 : 0);
+}
+
 enum PieceType {
     EMPTY  = 0,
     PAWN   = (1<<1),
@@ -73,22 +85,48 @@ struct Board {
     Board();
 
     std::unordered_set<U16> get_legal_moves() const;
+    // The same moves in their canonical order, ascending by move value,
+    // which does not depend on the standard library's hashing
+    std::vector<U16> get_sorted_legal_moves() const;
     bool in_check() const;
+    // Pseudo-legal moves of the side to play that land on square, which are
+    // its captures there when the other side has a piece on it
+    std::vector<U16> get_attacks_on(U8 square) const;
     Board* copy() const;
     void do_move(U16 move);
+    U64 hash() const;
+    // The smaller of hash() and the hash of mirror_board(*this), so that a
+    // position and its mirror image share one key; mirrored is set when the
+    // key is the mirror image's, and moves stored under it are mirrored too
+    U64 canonical_hash(bool *mirrored = nullptr) const;
 
     private:
-    std::unordered_set<U16> _get_pseudolegal_moves() const;
-    std::unordered_set<U16> _get_pseudolegal_moves_for_piece(U8 piece_pos) const;
+    // Specialized on the side whose moves are generated, or whose pieces
+    // are checked; the public functions above pick one once per call
+    template <PlayerColor color> std::unordered_set<U16> _get_legal_moves() const;
+    template <PlayerColor color> std::vector<U16> _get_sorted_legal_moves() const;
+    template <PlayerColor color> bool _in_check() const;
+    template <PlayerColor color> std::vector<U16> _get_attacks_on(U8 square) const;
+    template <PlayerColor color> std::unordered_set<U16> _get_pseudolegal_moves_for_piece(U8 piece_pos) const;
+    template <PlayerColor color> bool _under_threat(U8 piece_pos) const;
+    template <PlayerColor color> std::unordered_set<U16> _get_pseudolegal_moves_for_side() const;
     void _flip_player();
     void _do_move(U16 move);
-    bool _under_threat(U8 piece_pos) const;
     void _undo_last_move(U16 move);
-    std::unordered_set<U16> _get_pseudolegal_moves_for_side(U8 color) const;
 };
 
+// Builds a board from the 12 piece positions, in BoardData order, and the
+// piece (color | type) in each of those slots
+Board board_from_pieces(const U8 *positions, const U8 *pieces, PlayerColor player_to_play);
+
+// The position rotated by 180 degrees with the colors swapped, side to play
+// included. The start position and the rules are symmetric under this, so
+// the mirror image plays exactly like b, with its moves mapped by mirror_move.
+Board mirror_board(const Board& b);
+U16 mirror_move(U16 move);
+
 std::string move_to_str(U16 move);
-U16 str_to_move(std::string move);
+U16 str_to_move(std::string_view move);
 std::string board_to_str(const U8 *b);
 std::string all_boards_to_str(const Board& b);
 char piece_to_char(U8 piece);
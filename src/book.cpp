@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "book.hpp"
+
+const char BOOK_MAGIC[4] = {'R', 'B', 'B', 'K'};
+
+OpeningBook::~OpeningBook() {
+    close();
+}
+
+bool OpeningBook::open(const std::string& path) {
+
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(BookFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    data = (const char*)mapping;
+    length = st.st_size;
+
+    const BookFileHeader *header = (const BookFileHeader*)data;
+    if (memcmp(header->magic, BOOK_MAGIC, 4) != 0
+        || header->version != BOOK_FORMAT_VERSION
+        || sizeof(BookFileHeader) + header->n_entries * sizeof(BookEntry) > length) {
+        close();
+        return false;
+    }
+
+    entries = (const BookEntry*)(data + sizeof(BookFileHeader));
+    n_entries = header->n_entries;
+
+    // lookups are binary searches, read ahead would only waste memory
+    madvise(mapping, length, MADV_RANDOM);
+    return true;
+}
+
+void OpeningBook::close() {
+    if (data != nullptr) {
+        munmap((void*)data, length);
+        data = nullptr;
+        length = 0;
+        entries = nullptr;
+        n_entries = 0;
+    }
+}
+
+bool OpeningBook::is_open() const {
+    return data != nullptr;
+}
+
+size_t OpeningBook::size() const {
+    return n_entries;
+}
+
+std::vector<BookEntry> OpeningBook::probe(const Board& b) const {
+
+    std::vector<BookEntry> found;
+    if (entries == nullptr) return found;
+
+    bool mirrored;
+    U64 key = b.canonical_hash(&mirrored);
+    auto first = std::lower_bound(entries, entries + n_entries, key, [](const BookEntry& e, U64 k) {
+        return e.key < k;
+    });
+    for (auto it = first; it != entries + n_entries && it->key == key; it++) {
+        found.push_back(*it);
+        if (mirrored) found.back().move = mirror_move(it->move);
+    }
+    return found;
+}
+
+U16 OpeningBook::best_move(const Board& b) const {
+
+    auto found = probe(b);
+    if (found.empty()) return 0;
+
+    // hash collisions are possible, so only trust moves that are legal here
+    auto legal_moves = b.get_sorted_legal_moves();
+    for (auto& entry : found) {
+        // weight 0 is a move known to be bad, not one to play
+        if (entry.weight == 0) continue;
+        if (std::binary_search(legal_moves.begin(), legal_moves.end(), entry.move)) return entry.move;
+    }
+    return 0;
+}
+
+BookEntry book_entry(const Board& b, U16 move, U16 weight) {
+    bool mirrored;
+    U64 key = b.canonical_hash(&mirrored);
+    return BookEntry{key, mirrored ? mirror_move(move) : move, weight, 0};
+}
+
+bool write_book(const std::string& path, std::vector<BookEntry> entries) {
+
+    std::sort(entries.begin(), entries.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+
+    std::vector<BookEntry> merged;
+    for (auto& entry : entries) {
+        if (!merged.empty() && merged.back().key == entry.key && merged.back().move == entry.move) {
+            merged.back().weight = (U16)std::min(0xffff, merged.back().weight + entry.weight);
+        } else {
+            merged.push_back(entry);
+            merged.back().reserved = 0;
+        }
+    }
+    merged.erase(std::remove_if(merged.begin(), merged.end(), [](const BookEntry& e) {
+        return e.weight == 0;
+    }), merged.end());
+
+    std::stable_sort(merged.begin(), merged.end(), [](const BookEntry& a, const BookEntry& b) {
+        return a.key != b.key ? a.key < b.key : a.weight > b.weight;
+    });
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    BookFileHeader header = {};
+    memcpy(header.magic, BOOK_MAGIC, 4);
+    header.version = BOOK_FORMAT_VERSION;
+    header.n_entries = merged.size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(merged.data(), sizeof(BookEntry), merged.size(), file) == merged.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <cstdint>
+#include <string>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Opening book: a header followed by BookEntries sorted by (key, weight
+// descending, move), where key is Board::canonical_hash() of the position the
+// move is played from, and the move is mirrored along with the position when
+// the key is its mirror image's. The file is mapped read only and shared, so
+// every engine process on a host uses the same page cache copy.
+
+const uint32_t BOOK_FORMAT_VERSION = 2;
+
+struct BookFileHeader {
+    char magic[4];      // "RBBK"
+    uint32_t version;
+    uint64_t n_entries;
+};
+
+struct BookEntry {
+    U64 key;
+    U16 move;
+    U16 weight;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(BookEntry) == 16, "BookEntry must stay 16 bytes");
+
+class OpeningBook {
+
+    public:
+    ~OpeningBook();
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+    size_t size() const;
+
+    // Entries for b, heaviest first, with their moves as played in b; empty
+    // if b is not in the book
+    std::vector<BookEntry> probe(const Board& b) const;
+
+    // The heaviest legal book move for b with a weight above 0, or 0 if
+    // there is none
+    U16 best_move(const Board& b) const;
+
+    private:
+    const char *data = nullptr;
+    size_t length = 0;
+    const BookEntry *entries = nullptr;
+    size_t n_entries = 0;
+};
+
+// The entry for playing move in b
+BookEntry book_entry(const Board& b, U16 move, U16 weight);
+
+// Sorts entries, merges the weights of duplicate (key, move) pairs and writes
+// them as a book file
+bool write_book(const std::string& path, std::vector<BookEntry> entries);
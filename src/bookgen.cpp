@@ -0,0 +1,176 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "board.hpp"
+#include "book.hpp"
+#include "engine.hpp"
+#include "records.hpp"
+#include "selfplay.hpp"
+
+// Opening book builder. Moves come from two sources, which can be combined:
+//  - games: the first plies of every game in a records file (datagen
+//    --games-out), each move weighted by its average score for the side
+//    that played it, BOOK_DRAW_WEIGHT for a draw and twice that for a win.
+//    Moves that scored below a draw on average are left out
+//  - search: a tree from the start position in which one side plays the
+//    engine's move at a fixed depth and the other side every legal move,
+//    built once with each colour as the engine. With --multi-pv the
+//    engine's next best moves go in too, with lower weights, as
+//    alternatives to the move the tree continues with
+
+// weight of a game move that drew on average, well above the few points
+// the searched moves get, as games are the stronger evidence
+const int BOOK_DRAW_WEIGHT = 100;
+
+struct GameStats {
+    int games = 0;
+    int score = 0;
+};
+
+void add_games(RecordReader& reader, int plies, int min_games, std::vector<BookEntry>& entries) {
+
+    // keyed by position, then move
+    std::unordered_map<U64, std::unordered_map<U16, GameStats>> stats;
+    GameView game;
+    int n_games = 0;
+
+    while (reader.next_game(game)) {
+        if (game.result == RESULT_UNKNOWN) continue;
+        n_games++;
+        Board b;
+        for (int i = 0; i < game.n_moves && i < plies; i++) {
+            U16 m = game.moves[i];
+            // randomized opening moves say nothing about the move's quality
+            if (i >= game.opening_plies) {
+                bool white = (b.data.player_to_play == WHITE);
+                int score = (game.result == RESULT_DRAW ? 1 : (game.result == RESULT_WHITE_WIN) == white ? 2 : 0);
+                BookEntry played = book_entry(b, m, 0);
+                auto& s = stats[played.key][played.move];
+                s.games++;
+                s.score += score;
+            }
+            b.do_move(m);
+        }
+    }
+
+    int added = 0;
+    for (auto& position : stats) {
+        for (auto& move : position.second) {
+            const GameStats& s = move.second;
+            // scores are 2 for a win, so below a draw is under one a game
+            if (s.games < min_games || s.score < s.games) continue;
+            BookEntry entry = {position.first, move.first, (U16)((long long)BOOK_DRAW_WEIGHT * s.score / s.games), 0};
+            entries.push_back(entry);
+            added++;
+        }
+    }
+    std::cout << "games " << n_games << "  entries " << added << std::endl;
+}
+
+void add_searched(Board& b, int plies, PlayerColor engine_color, const SearchLimits& limits, int multi_pv,
+                  std::unordered_set<U64>& seen, std::vector<BookEntry>& entries) {
+
+    if (plies == 0) return;
+
+    auto moves = b.get_sorted_legal_moves();
+    if (moves.empty()) return;
+
+    if (b.data.player_to_play == engine_color) {
+        // a mirror image of a searched position is covered by its entry
+        if (!seen.insert(b.canonical_hash()).second) return;
+
+        Engine e;
+        e.verbose = false;
+        e.limits = limits;
+        e.search = true;
+        e.multi_pv = multi_pv;
+        e.find_best_move(b);
+        U16 m = e.best_move;
+
+        // best move first, weighted highest
+        for (size_t i = 0; i < e.lines.size(); i++) {
+            entries.push_back(book_entry(b, e.lines[i].move, (U16)(e.lines.size() - i)));
+        }
+        if (seen.size() % 100 == 0) {
+            std::cout << "searched " << seen.size() << " positions" << std::endl;
+        }
+
+        Board c = b;
+        c.do_move(m);
+        add_searched(c, plies - 1, engine_color, limits, multi_pv, seen, entries);
+    }
+    else {
+        for (U16 m : moves) {
+            Board c = b;
+            c.do_move(m);
+            add_searched(c, plies - 1, engine_color, limits, multi_pv, seen, entries);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball opening book builder");
+    std::string out_path, games_path;
+    int plies, min_games, search_plies, multi_pv;
+    SearchLimits limits;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    op.add<popl::Value<std::string>>("o", "out", "output book file", "book.bin", &out_path);
+    op.add<popl::Value<std::string>>("g", "games", "game records file to take moves from", "", &games_path);
+    op.add<popl::Value<int>>("", "plies", "plies of each game that go into the book", 12, &plies);
+    op.add<popl::Value<int>>("", "min-games", "games a move must appear in to be kept", 2, &min_games);
+    op.add<popl::Value<int>>("", "search-plies", "plies of the searched tree, 0 to skip it", 0, &search_plies);
+    op.add<popl::Value<int>>("", "depth", "search depth for the searched tree, in plies", 6, &limits.depth);
+    op.add<popl::Value<int>>("", "nodes", "search node limit, instead of the depth", 0, &limits.nodes);
+    op.add<popl::Value<int>>("", "multi-pv", "best moves of each searched position that go into the book", 1, &multi_pv);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    if (games_path.empty() && search_plies <= 0) {
+        std::cout << "ERROR: nothing to build from, give --games or --search-plies" << std::endl;
+        return 1;
+    }
+    if (limits.nodes > 0) {
+        limits.depth = 0;
+    }
+
+    std::vector<BookEntry> entries;
+
+    if (!games_path.empty()) {
+        RecordReader reader;
+        if (!reader.open(games_path, GAME_RECORDS)) {
+            std::cout << "ERROR: could not open " << games_path << std::endl;
+            return 1;
+        }
+        add_games(reader, plies, min_games, entries);
+    }
+
+    if (search_plies > 0) {
+        std::unordered_set<U64> seen;
+        for (PlayerColor color : {WHITE, BLACK}) {
+            Board b;
+            add_searched(b, search_plies, color, limits, std::max(multi_pv, 1), seen, entries);
+        }
+        std::cout << "searched " << seen.size() << " positions" << std::endl;
+    }
+
+    if (!write_book(out_path, entries)) {
+        std::cout << "ERROR: could not write " << out_path << std::endl;
+        return 1;
+    }
+
+    OpeningBook book;
+    if (book.open(out_path)) {
+        std::cout << "wrote " << book.size() << " entries to " << out_path << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "client.hpp"
+
+#include <functional>
+
+WebsocketClient::WebsocketClient()
+{
+    //Wire up our event handlers; a connection that fails to open is reported
+    //like one that closed
+    this->endpoint.set_open_handler(std::bind(&WebsocketClient::onOpen, this, std::placeholders::_1));
+    this->endpoint.set_close_handler(std::bind(&WebsocketClient::onClose, this, std::placeholders::_1));
+    this->endpoint.set_fail_handler(std::bind(&WebsocketClient::onClose, this, std::placeholders::_1));
+    this->endpoint.set_message_handler(std::bind(&WebsocketClient::onMessage, this, std::placeholders::_1, std::placeholders::_2));
+    
+    //Initialise the Asio library, using our own event loop object
+    this->endpoint.init_asio(&(this->eventLoop));
+}
+
+void WebsocketClient::run()
+{
+    //Keep running while no connection is open
+    this->endpoint.start_perpetual();
+    this->endpoint.run();
+}
+
+void WebsocketClient::stop()
+{
+    this->endpoint.stop_perpetual();
+    this->endpoint.stop();
+}
+
+bool WebsocketClient::open(const string& uri)
+{
+    websocketpp::lib::error_code ec;
+    WebsocketClientEndpoint::connection_ptr conn = this->endpoint.get_connection(uri, ec);
+    if (ec) {
+        return false;
+    }
+    
+    //The connection is made on the networking thread's event loop
+    this->endpoint.connect(conn);
+    return true;
+}
+
+bool WebsocketClient::sendMessage(ServerConnection conn, const string& message)
+{
+    //Unlike the server, a send to a connection that closed meanwhile is not an error
+    websocketpp::lib::error_code ec;
+    this->endpoint.send(conn, message, websocketpp::frame::opcode::text, ec);
+    return !ec;
+}
+
+void WebsocketClient::onOpen(ServerConnection conn)
+{
+    //Invoke any registered handlers
+    for (auto handler : this->connectHandlers) {
+        handler(conn);
+    }
+}
+
+void WebsocketClient::onClose(ServerConnection conn)
+{
+    //Invoke any registered handlers
+    for (auto handler : this->disconnectHandlers) {
+        handler(conn);
+    }
+}
+
+void WebsocketClient::onMessage(ServerConnection conn, WebsocketClientEndpoint::message_ptr msg)
+{
+    //Hand the payload to the handlers by reference, without copying it
+    const string& message = msg->get_payload();
+
+    for (auto handler : this->messageHandlers) {
+        handler(conn, message);
+    }
+}
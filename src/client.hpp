@@ -0,0 +1,75 @@
+#pragma once
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+typedef websocketpp::client<websocketpp::config::asio_client> WebsocketClientEndpoint;
+typedef websocketpp::connection_hdl ServerConnection;
+
+// Client side counterpart of WebsocketServer, for one process to connect to
+// others' servers
+class WebsocketClient
+{
+    public:
+        
+        WebsocketClient();
+        
+        //Runs the event loop until stop() is called
+        void run();
+        void stop();
+        
+        //Starts connecting to a ws:// URI; the connect or disconnect handlers
+        //are called with its handle once that succeeded or failed
+        bool open(const string& uri);
+        
+        //Registers a callback for when a connection opens
+        template <typename CallbackTy>
+        void connect(CallbackTy handler)
+        {
+            //Make sure we only access the handlers list from the networking thread
+            this->eventLoop.post([this, handler]() {
+                this->connectHandlers.push_back(handler);
+            });
+        }
+        
+        //Registers a callback for when a connection closes or fails to open
+        template <typename CallbackTy>
+        void disconnect(CallbackTy handler)
+        {
+            //Make sure we only access the handlers list from the networking thread
+            this->eventLoop.post([this, handler]() {
+                this->disconnectHandlers.push_back(handler);
+            });
+        }
+        
+        //Registers a callback for when a message is received
+        template <typename CallbackTy>
+        void message(CallbackTy handler)
+        {
+            //Make sure we only access the handlers list from the networking thread
+            this->eventLoop.post([this, handler]() {
+                this->messageHandlers.push_back(handler);
+            });
+        }
+        
+        //Sends a message to a server; returns false if the connection is gone
+        bool sendMessage(ServerConnection conn, const string& message);
+        
+    protected:
+        void onOpen(ServerConnection conn);
+        void onClose(ServerConnection conn);
+        void onMessage(ServerConnection conn, WebsocketClientEndpoint::message_ptr msg);
+
+        asio::io_service eventLoop;
+        WebsocketClientEndpoint endpoint;
+        
+        vector<std::function<void(ServerConnection)>> connectHandlers;
+        vector<std::function<void(ServerConnection)>> disconnectHandlers;
+        vector<std::function<void(ServerConnection, const string&)>> messageHandlers;
+};
@@ -0,0 +1,167 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "engine.hpp"
+#include "records.hpp"
+#include "selfplay.hpp"
+
+// Self-play training data: plays low depth or fixed node games from random
+// openings and writes quiet positions, labelled with the search score and the
+// final game result, as PositionRecords.
+
+// scores beyond this are mate sentinels rather than evaluations
+const int MAX_LABEL_SCORE = 30000;
+// games in a row without a kept position after which generation gives up,
+// as the settings then hardly ever keep one
+const int MAX_BARREN_GAMES = 1000;
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball training data generator");
+    std::string out_path, games_path;
+    int positions, concurrency, opening_plies, max_moves, seed;
+    double sample_rate;
+    SearchLimits limits;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    op.add<popl::Value<std::string>>("o", "out", "output position file", "positions.bin", &out_path);
+    op.add<popl::Value<std::string>>("", "games-out", "also write the games to this file", "", &games_path);
+    op.add<popl::Value<int>>("n", "positions", "number of positions to generate", 100000, &positions);
+    op.add<popl::Value<int>>("c", "concurrency", "games played in parallel", std::thread::hardware_concurrency(), &concurrency);
+    op.add<popl::Value<int>>("", "depth", "search depth, in plies", 2, &limits.depth);
+    op.add<popl::Value<int>>("", "nodes", "search node limit, instead of the depth", 0, &limits.nodes);
+    op.add<popl::Value<int>>("", "opening-plies", "random plies played before the engines take over", 8, &opening_plies);
+    op.add<popl::Value<int>>("", "max-moves", "moves per side before the game is drawn", 100, &max_moves);
+    op.add<popl::Value<double>>("", "sample-rate", "fraction of the quiet positions that are kept", 0.25, &sample_rate);
+    op.add<popl::Value<int>>("", "seed", "seed for the openings and sampling", 1, &seed);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    if (limits.nodes > 0) {
+        limits.depth = 0;
+    }
+    if (!(sample_rate > 0)) {
+        std::cout << "ERROR: --sample-rate must be above 0" << std::endl;
+        return 1;
+    }
+    // each side plays up to max_moves after the opening, and a game record
+    // holds at most 65535 moves, 255 of them random
+    if (opening_plies < 0 || opening_plies > UINT8_MAX || max_moves < 1
+        || opening_plies + 2LL * max_moves > UINT16_MAX) {
+        std::cout << "ERROR: --opening-plies must be within 0-255, and --max-moves within 1-"
+                  << (UINT16_MAX - std::max(opening_plies, 0)) / 2 << std::endl;
+        return 1;
+    }
+    concurrency = std::max(concurrency, 1);
+
+    RecordWriter writer, games_writer;
+    if (!writer.open(out_path, POSITION_RECORDS)) {
+        std::cout << "ERROR: could not open " << out_path << std::endl;
+        return 1;
+    }
+    if (!games_path.empty() && !games_writer.open(games_path, GAME_RECORDS)) {
+        std::cout << "ERROR: could not open " << games_path << std::endl;
+        return 1;
+    }
+
+    std::mutex writer_mutex;
+    std::atomic<int> next_game(0);
+    std::atomic<int> written(0);
+    // a write failed, and the output would only be truncated further
+    std::atomic<bool> write_failed(false);
+    std::atomic<int> barren_games(0);
+    int games_played = 0;
+    auto start_time = std::chrono::steady_clock::now();
+
+    auto report = [&]() {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << "games " << games_played << "  positions " << written
+                  << "  pos/s " << written / seconds
+                  << "  pos/s/core " << written / seconds / concurrency << std::endl;
+    };
+
+    auto worker = [&]() {
+        std::vector<PositionRecord> samples;
+        std::vector<U16> opening_moves;
+
+        while (written < positions && !write_failed && barren_games < MAX_BARREN_GAMES) {
+            int g = next_game++;
+            std::mt19937 rng(seed + g);
+            std::uniform_real_distribution<double> coin(0, 1);
+            Board opening = random_opening(opening_plies, rng, &opening_moves);
+
+            // keep quiet positions: not in check, with a non capture best move
+            // and a score that is not a mate sentinel
+            samples.clear();
+            auto on_move = [&](const Board& b, const Engine& e, U16 move) {
+                int score = e.best_eval.total;
+                if (b.data.board_0[getp1(move)] != 0 || std::abs((long long)score) > MAX_LABEL_SCORE) return;
+                if (b.in_check() || coin(rng) >= sample_rate) return;
+                samples.push_back(make_position_record(b, score, RESULT_UNKNOWN));
+            };
+            GameOutcome outcome = play_game(opening, limits, limits, max_moves, on_move);
+
+            RecordResult result = (outcome.result > 0 ? RESULT_WHITE_WIN : outcome.result < 0 ? RESULT_BLACK_WIN : RESULT_DRAW);
+            for (auto& record : samples) {
+                set_record_result(record, result);
+            }
+
+            std::lock_guard<std::mutex> lock(writer_mutex);
+            barren_games = (samples.empty() ? barren_games + 1 : 0);
+            for (auto& record : samples) {
+                if (written >= positions) break;
+                if (!writer.write(record)) {
+                    write_failed = true;
+                    break;
+                }
+                written++;
+            }
+            if (!games_path.empty()) {
+                opening_moves.insert(opening_moves.end(), outcome.moves.begin(), outcome.moves.end());
+                if (!games_writer.write_game(opening_moves, result, opening_plies)) write_failed = true;
+            }
+            if (++games_played % 100 == 0) {
+                report();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < concurrency; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    bool positions_ok = writer.close();
+    bool games_ok = games_writer.close();
+    report();
+
+    if (!positions_ok) {
+        std::cout << "ERROR: could not write " << out_path << std::endl;
+        return 1;
+    }
+    if (!games_ok) {
+        std::cout << "ERROR: could not write " << games_path << std::endl;
+        return 1;
+    }
+    if (written < positions) {
+        std::cout << "ERROR: no position kept in " << MAX_BARREN_GAMES << " games in a row, stopped at " << written << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -2,13 +2,17 @@
 #include <chrono>
 #include <iostream>
 #include <climits>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
 using namespace std;
 
 #include "board.hpp"
+#include "book.hpp"
 #include "engine.hpp"
+#include "nnue.hpp"
+#include "tablebase.hpp"
 
 int MIN_SEARCH_DEPTH = 2;
 int MAX_SEARCH_DEPTH = 6;
@@ -22,63 +26,43 @@ const int CHECK_WEIGHT = 99;
 const int STALEMATE_WEIGHT = 1000;
 const int REPETITION_WEIGHT = 1000;
 const int RING_WEIGHT = 20;
+// above any eval, but below the INT_MIN / INT_MAX of a mate in the tree
+const int TABLEBASE_WEIGHT = 100000;
+
+// keys positions where the root player is not the one to play apart, as eval
+// is not symmetric between the two
+const U64 TT_OPPONENT_KEY = 0x9d39247e33776d41ULL;
 
 const int ATTACKING_FACTOR = 6;
 const int DEFENDING_FACTOR = 4;
 
-int nodes_visited;
-int curr_player = -1;
+// part of the table fingerprint, to bump when eval or the search change the
+// scores they give in a way the weights here do not show
+const int SCORE_VERSION = 1;
+
+// a depth limit alone would never end an MCTS search, so it buys this many
+// simulations a ply instead
+const int MCTS_SIMULATIONS_PER_DEPTH = 1000;
 
-int PLAYER_WEIGHTS[6] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT};
-int OPPONENT_WEIGHTS[6] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT};
+const int PIECE_WEIGHTS[6] = {ROOK_WEIGHT, ROOK_WEIGHT, KING_WEIGHT, BISHOP_WEIGHT, PAWN_WEIGHT, PAWN_WEIGHT};
 
-unordered_map<U8, int> quadrants;
+// read-only after init_quadrant_map, so it is safe to share between engines
+int quadrants[64];
+once_flag quadrants_initialized;
 U8 quad_points[4] = {pos(1, 1), pos(1, 5), pos(5, 5), pos(5, 1)};
 
-unordered_map<string, int> previous_board_occurences;
-
-struct Evaluation {
-    int piece_weight    = 0;
-    int promo           = 0;
-    int check           = 0;
-    int king_distance   = 0;
-    int depth           = 0;
-    int attack          = 0;
-    int ring_weight     = 0;
-    int total           = 0;
-    vector<U16> moves;
-
-    void reset() {
-        piece_weight    = 0;
-        promo           = 0;
-        attack          = 0;
-        check           = 0;
-        king_distance   = 0;
-        ring_weight     = 0;
-        total           = 0;
-    }
-
-    void update_total() {
-        total = 0;
-        total += piece_weight;
-        total += attack;
-        total += promo;
-        total += check;
-        total += king_distance;
-        total += ring_weight;
-    }
-
-    void print() {
-        cout << "piece weight   " << piece_weight << '\n';
-        cout << "promo          " << promo << '\n';
-        cout << "attack         " << attack << '\n';
-        cout << "check          " << check << '\n';
-        cout << "depth          " << depth << '\n';
-        cout << "king distance  " << king_distance << '\n';
-        cout << "ring weight    " << ring_weight << '\n';
-        cout << "total          " << total << '\n';
-    }
-};
+void Evaluation::print() {
+    cout << "piece weight   " << piece_weight << '\n';
+    cout << "promo          " << promo << '\n';
+    cout << "attack         " << attack << '\n';
+    cout << "check          " << check << '\n';
+    cout << "depth          " << depth << '\n';
+    cout << "king distance  " << king_distance << '\n';
+    cout << "ring weight    " << ring_weight << '\n';
+    cout << "nnue           " << nnue << '\n';
+    cout << "tablebase      " << tablebase << '\n';
+    cout << "total          " << total << '\n';
+}
 
 void flip_player(Board& b) {
     b.data.player_to_play = (PlayerColor)(b.data.player_to_play ^ (WHITE | BLACK));
@@ -173,16 +157,82 @@ int get_rook_distance(U8 rook_pos, U8 final_pos) {
     return distance;
 }
 
+int see_value(U8 piece) {
+    if (piece & PAWN)   return PAWN_WEIGHT;
+    if (piece & BISHOP) return BISHOP_WEIGHT;
+    if (piece & ROOK)   return ROOK_WEIGHT;
+    if (piece & KING)   return KING_WEIGHT;
+    return 0;
+}
+
+// value of the piece that move leaves on its target square
+int see_moved_value(const Board& b, U16 move) {
+    if (getpromo(move) & PAWN_ROOK)   return ROOK_WEIGHT;
+    if (getpromo(move) & PAWN_BISHOP) return BISHOP_WEIGHT;
+    return see_value(b.data.board_0[getp0(move)]);
+}
+
+int see(const Board& b, U16 move) {
+
+    U8 square = getp1(move);
+    U8 mover = b.data.board_0[getp0(move)];
+
+    // gain[d] is the balance for the side making capture d if the exchange
+    // stopped right after it
+    int gain[16];
+    int d = 0;
+    gain[0] = see_value(b.data.board_0[square]) + see_moved_value(b, move) - see_value(mover);
+
+    Board c = b;
+    c.data.player_to_play = (PlayerColor)(mover & (WHITE | BLACK));
+    int on_square = see_moved_value(c, move);
+    c.do_move(move);
+
+    while (d < 15) {
+        // recapture with the least valuable piece, promoting to a rook
+        U16 recapture = 0;
+        int recapture_value = INT_MAX;
+        for (U16 m : c.get_attacks_on(square)) {
+            int value = see_value(c.data.board_0[getp0(m)]);
+            if (value < recapture_value || (value == recapture_value && (getpromo(m) & PAWN_ROOK))) {
+                recapture = m;
+                recapture_value = value;
+            }
+        }
+        if (!recapture) break;
+
+        Board next = c;
+        next.do_move(recapture);
+        // a king cannot take a defended piece
+        if ((c.data.board_0[getp0(recapture)] & KING) && !next.get_attacks_on(square).empty()) break;
+
+        d++;
+        gain[d] = on_square + see_moved_value(c, recapture) - recapture_value - gain[d - 1];
+        on_square = see_moved_value(c, recapture);
+        c = next;
+    }
+
+    // either side stops recapturing once it no longer pays
+    while (d > 0) {
+        d--;
+        gain[d] = -max(-gain[d], gain[d + 1]);
+    }
+    return gain[0];
+}
+
+// Static evaluation from the point of view of curr_player, which fixes where
+// each side's pieces are in BoardData and where its pawns promote
+template <PlayerColor curr_player>
 Evaluation eval(Board& b) {
 
-    U8 white_pieces[6] = {b.data.w_rook_ws, b.data.w_rook_bs, b.data.w_king, b.data.w_bishop, b.data.w_pawn_ws, b.data.w_pawn_bs};
-    U8 black_pieces[6] = {b.data.b_rook_ws, b.data.b_rook_bs, b.data.b_king, b.data.b_bishop, b.data.b_pawn_ws, b.data.b_pawn_bs};
+    constexpr PlayerColor opponent = opponent_of(curr_player);
 
-    U8* player_pieces = (curr_player == WHITE ? white_pieces : black_pieces);
-    U8* opponent_pieces = (curr_player == WHITE ? black_pieces : white_pieces);
+    // eval only flips the side to play, so these stay valid throughout
+    const U8* player_pieces = (const U8*)(&(b.data)) + first_piece_slot(curr_player);
+    const U8* opponent_pieces = (const U8*)(&(b.data)) + first_piece_slot(opponent);
 
-    U8 player_promo = (curr_player == WHITE ? pos(4, 5) : pos(2, 0));
-    U8 opponent_promo = (curr_player == WHITE ? pos(2, 0) : pos(4, 5));
+    constexpr U8 player_promo = (curr_player == WHITE ? pos(4, 5) : pos(2, 0));
+    constexpr U8 opponent_promo = (opponent == WHITE ? pos(4, 5) : pos(2, 0));
 
     U8 player_king = player_pieces[2];
     U8 opponent_king = opponent_pieces[2];
@@ -195,6 +245,10 @@ Evaluation eval(Board& b) {
 
     Evaluation score;
 
+    int PLAYER_WEIGHTS[6], OPPONENT_WEIGHTS[6];
+    copy(PIECE_WEIGHTS, PIECE_WEIGHTS + 6, PLAYER_WEIGHTS);
+    copy(PIECE_WEIGHTS, PIECE_WEIGHTS + 6, OPPONENT_WEIGHTS);
+
     for (int i = 4; i < 6; i++) {
         if (player_pieces[i] == DEAD) {
 
@@ -251,11 +305,12 @@ Evaluation eval(Board& b) {
         }
     };
 
+    // only attacks that do not lose material in the exchange threaten anything
     auto add_attack_score = [&]() {
         for (auto move : player_moves) {
             U8 final_pos = getp1(move);
             for (int i = 0; i < 6; i++) {
-                if (final_pos == opponent_pieces[i] && i != 2) {
+                if (final_pos == opponent_pieces[i] && i != 2 && see(b, move) >= 0) {
                     score.attack += PLAYER_WEIGHTS[i] / ATTACKING_FACTOR;
                 }
             }
@@ -263,7 +318,7 @@ Evaluation eval(Board& b) {
         for (auto move : opponent_moves) {
             U8 final_pos = getp1(move);
             for (int i = 0; i < 6; i++) {
-                if (final_pos == player_pieces[i] && i != 2) {
+                if (final_pos == player_pieces[i] && i != 2 && see(b, move) >= 0) {
                     score.attack -= OPPONENT_WEIGHTS[i] / DEFENDING_FACTOR;
                 }
             }
@@ -281,7 +336,7 @@ Evaluation eval(Board& b) {
         }
     };
 
-    auto calc_promo_score = [&](U8* pieces, U8 promo_pos) {
+    auto calc_promo_score = [&](const U8* pieces, U8 promo_pos) {
         int promo_score = 0;
         U8 promo_pos_y = gety(promo_pos);
         U8 piece_y;
@@ -379,6 +434,36 @@ Evaluation eval(Board& b) {
     return score;
 }
 
+Evaluation eval(Board& b, int curr_player) {
+    return (curr_player == WHITE ? eval<WHITE>(b) : eval<BLACK>(b));
+}
+
+int evaluate(const Board& b) {
+    call_once(quadrants_initialized, init_quadrant_map);
+    Board c = b;
+    return eval(c, c.data.player_to_play).total;
+}
+
+// Network evaluation of b from the point of view of curr_player, with the
+// same mate scores as eval
+Evaluation eval_nnue(Board& b, const NnueAccumulator& acc, int curr_player) {
+    Evaluation score;
+    if (b.in_check() && b.get_legal_moves().empty()) {
+        score.check = (b.data.player_to_play == curr_player ? INT_MIN : INT_MAX);
+    } else {
+        int nnue = nnue_evaluate(acc, b.data.player_to_play);
+        score.nnue = (b.data.player_to_play == curr_player ? nnue : -nnue);
+    }
+    score.update_total();
+    return score;
+}
+
+// Exact score of a tablebase result, for the side to play, preferring faster
+// wins and slower losses
+int tablebase_score(const TBResult& r) {
+    return r.result * (TABLEBASE_WEIGHT - r.plies);
+}
+
 bool is_equal(Board* b1, Board* b2) {
     bool is_king_equal = (b1->data.b_king == b2->data.b_king) && (b1->data.w_king == b2->data.w_king);
     bool is_rook_ws_equal = (b1->data.b_rook_ws == b2->data.b_rook_ws) && (b1->data.w_rook_ws == b2->data.w_rook_ws);
@@ -390,29 +475,109 @@ bool is_equal(Board* b1, Board* b2) {
     return is_equal;
 }
 
+// Orders the captures that win material first, most first, then the other
+// moves, then the captures that lose material, keeping the canonical order
+// within each group. Returns where the losing captures start.
+size_t order_moves(const Board& b, vector<U16>& moves) {
+
+    vector<pair<int, U16>> captures, losing;
+    vector<U16> quiet;
+    for (U16 m : moves) {
+        if (!b.data.board_0[getp1(m)]) {
+            quiet.push_back(m);
+            continue;
+        }
+        int gain = see(b, m);
+        (gain >= 0 ? captures : losing).push_back({gain, m});
+    }
+    auto by_gain = [](const pair<int, U16>& x, const pair<int, U16>& y) {
+        return x.first > y.first;
+    };
+    stable_sort(captures.begin(), captures.end(), by_gain);
+    stable_sort(losing.begin(), losing.end(), by_gain);
+
+    moves.clear();
+    for (auto& c : captures) moves.push_back(c.second);
+    moves.insert(moves.end(), quiet.begin(), quiet.end());
+    size_t losing_start = moves.size();
+    for (auto& c : losing) moves.push_back(c.second);
+    return losing_start;
+}
+
 bool is_better_eval(Evaluation& eval1, Evaluation& eval2, bool maximizing_player) {
     bool res = (maximizing_player ? eval1.total > eval2.total : eval1.total < eval2.total);
     res = res || (eval1.total == eval2.total && eval1.depth < eval2.depth);
     return res;
 }
 
-Evaluation minimax(Board& board, int depth, bool maximizing_player, vector<Board*> &visited, int alpha, int beta, atomic<bool>& search) {
+// acc is the network accumulator of board, or nullptr for the classic
+// evaluation. The quiescence re-search skips captures that lose material.
+Evaluation minimax(Board& board, int depth, bool maximizing_player, vector<Board*> &visited, int alpha, int beta, Engine& e, const NnueAccumulator* acc, bool quiescence = false) {
     Evaluation best_eval;
-    if (previous_board_occurences[board_to_str(board.data.board_0)] == 2) {
+    if (e.previous_board_occurences[board_to_str(board.data.board_0)] == 2) {
         best_eval.total = (maximizing_player ? 1 : -1) * REPETITION_WEIGHT;
         return best_eval;
     }
+    TBResult tb;
+    if (e.tablebases && e.tablebases->probe(board, tb)) {
+        STATS(e.stats.tb_hits++);
+        best_eval.tablebase = (board.data.player_to_play == e.curr_player ? 1 : -1) * tablebase_score(tb);
+        best_eval.update_total();
+        return best_eval;
+    }
     if (depth == 0) {
-        return eval(board);
+        STATS(StatsTimer timer(e.stats.eval_ns));
+        return (acc ? eval_nnue(board, *acc, e.curr_player) : eval(board, e.curr_player));
+    }
+    // scores are stored from the root player's point of view, which the
+    // mirror image shares as it swaps both colors
+    bool mirrored;
+    U64 key = board.canonical_hash(&mirrored) ^ (board.data.player_to_play == e.curr_player ? 0 : TT_OPPONENT_KEY);
+    TTEntry entry;
+    bool tt_hit = e.tt.probe(key, entry);
+    if (tt_hit) {
+        STATS(e.stats.tt_hits++);
+        // eval swings between odd and even depths, so a deeper result only
+        // stands in for one of the same parity
+        if (entry.depth >= depth && (entry.depth - depth) % 2 == 0 && (entry.bound == TT_EXACT
+                                                                    || (entry.bound == TT_LOWER && entry.score >= beta)
+                                                                    || (entry.bound == TT_UPPER && entry.score <= alpha))) {
+            STATS(e.stats.tt_cutoffs++);
+            best_eval.total = entry.score;
+            return best_eval;
+        }
     }
+    int alpha_orig = alpha, beta_orig = beta;
     best_eval.total = (maximizing_player ? INT_MIN : INT_MAX);
-    auto player_moveset = board.get_legal_moves();
+    vector<U16> player_moveset;
+    {
+        STATS(StatsTimer timer(e.stats.movegen_ns));
+        player_moveset = board.get_sorted_legal_moves();
+    }
     if (player_moveset.empty() && !board.in_check()) {
         best_eval.total = (maximizing_player ? 1 : -1) * STALEMATE_WEIGHT;
         return best_eval;
     }
-    for (auto iter = player_moveset.begin(); iter != player_moveset.end() && search; iter++) {
+    size_t losing_start = order_moves(board, player_moveset);
+    // the stored best move is searched first
+    if (tt_hit && entry.move) {
+        U16 tt_move = (mirrored ? mirror_move(entry.move) : entry.move);
+        auto it = find(player_moveset.begin(), player_moveset.end(), tt_move);
+        if (it != player_moveset.end()) {
+            if ((size_t)(it - player_moveset.begin()) >= losing_start) losing_start++;
+            rotate(player_moveset.begin(), it, it + 1);
+        }
+    }
+    U16 best_move = 0;
+    STATS(int move_number = 0);
+    for (auto iter = player_moveset.begin(); iter != player_moveset.end() && e.keep_searching(); iter++) {
+        // with some move searched, the losing captures left are not worth it
+        if (quiescence && best_move && (size_t)(iter - player_moveset.begin()) >= losing_start) break;
         auto move = *iter;
+        NnueAccumulator child;
+        if (acc) {
+            nnue_update(*acc, board, move, child);
+        }
         Board* new_board = board.copy();
         new_board->do_move(move);
         bool is_visited_board = false;
@@ -427,14 +592,15 @@ Evaluation minimax(Board& board, int depth, bool maximizing_player, vector<Board
             continue;
         }
         visited.push_back(new_board);
-        nodes_visited++;
-        Evaluation eval = minimax(*new_board, depth - 1, !maximizing_player, visited, alpha, beta, search);
+        e.nodes_visited++;
+        Evaluation eval = minimax(*new_board, depth - 1, !maximizing_player, visited, alpha, beta, e, acc ? &child : nullptr, quiescence);
         eval.depth++;
         eval.moves.push_back(move);
         free(new_board);
         visited.pop_back();
         if (is_better_eval(eval, best_eval, maximizing_player)) {
             best_eval = eval;
+            best_move = move;
         }
         if (maximizing_player) {
             alpha = max(alpha, best_eval.total);
@@ -442,59 +608,343 @@ Evaluation minimax(Board& board, int depth, bool maximizing_player, vector<Board
             beta = min(beta, best_eval.total);
         }
         if (alpha >= beta) {
+            STATS(e.stats.cutoffs++; e.stats.first_move_cutoffs += (move_number == 0));
             break;
         }
+        STATS(move_number++);
+    }
+    // an interrupted search, or one where every move repeated the path, says
+    // nothing about the position, and a quiescence one left moves out
+    if (best_move && e.search && !quiescence) {
+        TTBound bound = (best_eval.total <= alpha_orig ? TT_UPPER : best_eval.total >= beta_orig ? TT_LOWER : TT_EXACT);
+        e.tt.store(key, best_eval.total, mirrored ? mirror_move(best_move) : best_move, depth, bound);
     }
     return best_eval;
 }
 
+// Plays up to plies more moves of the principal variation on b from the
+// table, for lines cut short by a table hit; eval.moves is in reverse order
+void extend_pv(Board& b, Evaluation& eval, int plies, Engine& e) {
+    for (; plies > 0; plies--) {
+        bool mirrored;
+        U64 key = b.canonical_hash(&mirrored) ^ (b.data.player_to_play == e.curr_player ? 0 : TT_OPPONENT_KEY);
+        TTEntry entry;
+        if (!e.tt.probe(key, entry) || !entry.move) return;
+        U16 move = (mirrored ? mirror_move(entry.move) : entry.move);
+        auto moves = b.get_sorted_legal_moves();
+        if (!binary_search(moves.begin(), moves.end(), move)) return;
+        b.do_move(move);
+        eval.moves.insert(eval.moves.begin(), move);
+        eval.depth++;
+    }
+}
+
+U64 Engine::tt_fingerprint() const {
+    const long long params[] = {
+        SCORE_VERSION, QUIESCENCE_DEPTH, (long long)TT_OPPONENT_KEY,
+        PAWN_WEIGHT, ROOK_WEIGHT, BISHOP_WEIGHT, KING_WEIGHT, CHECK_WEIGHT, STALEMATE_WEIGHT,
+        REPETITION_WEIGHT, RING_WEIGHT, TABLEBASE_WEIGHT, ATTACKING_FACTOR, DEFENDING_FACTOR,
+        (long long)(use_nnue && nnue_loaded() ? nnue_fingerprint() : 0),
+    };
+    // FNV-1a
+    U64 h = 0xcbf29ce484222325ULL;
+    for (long long p : params) {
+        for (int i = 0; i < 8; i++) {
+            h = (h ^ ((p >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+
+// Scores every root move on e.workers, and on success fills lines with all
+// of them, best first. Returns false if the workers were busy with another
+// search, or were stopped or lost before they finished.
+bool search_on_workers(Engine& e, const Board& b, int depth, const vector<U16>& moves, vector<SearchLine>& lines) {
+
+    if (moves.empty()) return false;
+
+    vector<string> repeated;
+    for (auto& it : e.previous_board_occurences) {
+        if (it.second == 2) repeated.push_back(it.first);
+    }
+
+    // the workers' nodes do not pass through keep_searching, so the time
+    // limit is checked here
+    auto keep_searching = [&e]() {
+        if (e.limits.movetime_ms > 0 && chrono::steady_clock::now() - e.start_time >= chrono::milliseconds(e.limits.movetime_ms)) {
+            e.search = false;
+        }
+        return e.search.load();
+    };
+
+    vector<RootResult> results;
+    bool done = e.workers->search(b, repeated, moves, depth + 1, keep_searching, results);
+    for (auto& r : results) {
+        e.nodes_visited += r.nodes;
+    }
+    if (!done) return false;
+
+    // a worker searching a single move always takes it, so the quiescence
+    // check at the end of the variation that find_best_move makes before it
+    // prefers a later move is made here
+    bool nnue = e.use_nnue && nnue_loaded();
+    vector<bool> stable(moves.size());
+    for (size_t i = 0; i < moves.size(); i++) {
+        RootResult& r = results[i];
+        if (r.pv.empty() || r.pv[0] != moves[i]) r.pv.assign(1, moves[i]);
+        Board leaf = b;
+        for (U16 m : r.pv) {
+            leaf.do_move(m);
+        }
+        NnueAccumulator acc;
+        if (nnue) {
+            nnue_refresh(leaf, acc);
+        }
+        vector<Board*> visited;
+        e.nodes_visited++;
+        Evaluation q = minimax(leaf, QUIESCENCE_DEPTH, (r.pv.size() % 2 == 0), visited, INT_MIN, INT_MAX, e, nnue ? &acc : nullptr, true);
+        stable[i] = (q.total >= r.score);
+    }
+
+    // the same choice as the root loop, again for every further line
+    vector<size_t> remaining(moves.size());
+    for (size_t i = 0; i < remaining.size(); i++) remaining[i] = i;
+    lines.clear();
+    while (!remaining.empty()) {
+        size_t best = 0;
+        for (size_t k = 1; k < remaining.size(); k++) {
+            RootResult& x = results[remaining[k]];
+            RootResult& y = results[remaining[best]];
+            if (stable[remaining[k]] && (x.score > y.score || (x.score == y.score && x.pv.size() < y.pv.size()))) best = k;
+        }
+        RootResult& r = results[remaining[best]];
+        lines.push_back(SearchLine{moves[remaining[best]], r.score, r.pv});
+        remaining.erase(remaining.begin() + best);
+    }
+    return true;
+}
+
+// Runs the Monte Carlo tree search in place of the depth loop of
+// find_best_move, and reports it in the same fields
+void search_mcts(Engine& e, const Board& b, const vector<U16>& moves) {
+
+    long long budget = 0;
+    if (e.limits.nodes <= 0 && e.limits.depth > 0) {
+        budget = (long long)e.limits.depth * MCTS_SIMULATIONS_PER_DEPTH;
+    }
+    e.mcts.resize(e.hash_mb);
+    e.mcts.search(b, moves, e.use_nnue && nnue_loaded(), e.previous_board_occurences, e.tablebases, [&e, budget](long long simulations) {
+        // a simulation costs far more than a node, so the time is checked
+        // after every one rather than every 256
+        e.nodes_visited = simulations;
+        if (budget > 0 && simulations >= budget) {
+            e.search = false;
+        }
+        if (e.limits.movetime_ms > 0 && chrono::steady_clock::now() - e.start_time >= chrono::milliseconds(e.limits.movetime_ms)) {
+            e.search = false;
+        }
+        return e.keep_searching();
+    });
+
+    e.lines.clear();
+    for (auto& l : e.mcts.lines(max(e.multi_pv, 1))) {
+        e.lines.push_back(SearchLine{l.move, l.score, l.pv});
+    }
+    if (e.lines.empty()) return;
+    e.best_move = e.lines[0].move;
+    e.best_eval = Evaluation();
+    e.best_eval.total = e.lines[0].score;
+    e.best_eval.depth = e.lines[0].pv.size();
+    e.pv = e.lines[0].pv;
+    e.depth_reached = e.pv.size();
+}
+
 void Engine::find_best_move(const Board& b) {
-    auto start_time = chrono::high_resolution_clock::now();
+    auto network = nnue_use();
+    start_time = chrono::steady_clock::now();
     previous_board_occurences[board_to_str(b.data.board_0)]++;
-    if (curr_player == -1) {
-        curr_player = b.data.player_to_play;
-        init_quadrant_map();
-    }
-    Evaluation best_eval;
+    curr_player = b.data.player_to_play;
+    call_once(quadrants_initialized, init_quadrant_map);
+    best_eval = Evaluation();
     best_eval.total = INT_MIN;
     best_eval.depth = MAX_SEARCH_DEPTH;
-    auto player_moveset = b.get_legal_moves();
+    pv.clear();
+    lines.clear();
+    depth_reached = 0;
+    stats.reset();
+    tt.resize(hash_mb);
+    auto player_moveset = b.get_sorted_legal_moves();
+    auto searchable = [&](U16 m) {
+        return limits.searchmoves.empty() || find(limits.searchmoves.begin(), limits.searchmoves.end(), m) != limits.searchmoves.end();
+    };
+    player_moveset.erase(remove_if(player_moveset.begin(), player_moveset.end(), [&](U16 m) {
+        return !searchable(m);
+    }), player_moveset.end());
     this->best_move = 0;
     vector<Board*> visited;
     nodes_visited = 0;
-    for (int depth = MIN_SEARCH_DEPTH - 1; depth < MAX_SEARCH_DEPTH && this->search; depth++) {
+    int max_depth = (limits.depth > 0 ? limits.depth : MAX_SEARCH_DEPTH);
+    bool nnue = use_nnue && nnue_loaded();
+    NnueAccumulator root_acc, child_acc, quiescence_acc;
+    if (nnue) {
+        nnue_refresh(b, root_acc);
+    }
+    // positions with a known answer are not searched
+    U16 book_move = (book ? book->best_move(b) : 0);
+    if (!searchable(book_move)) book_move = 0;
+    TBResult tb;
+    U16 tb_move = (!book_move && tablebases ? tablebases->best_move(b, &tb) : 0);
+    if (!searchable(tb_move)) tb_move = 0;
+    U16 known_move = (book_move ? book_move : tb_move);
+    if (known_move) {
+        this->best_move = known_move;
+        best_eval.total = 0;
+        if (tb_move) {
+            best_eval.tablebase = tablebase_score(tb);
+            best_eval.update_total();
+        }
+        pv.assign(1, known_move);
+    }
+    // a forced mate is played without searching, whether it was asked for
+    // or found by the cheaper check
+    int mate_moves = (limits.mate > 0 ? limits.mate : mate_check);
+    MateResult mate;
+    if (!known_move && mate_moves > 0) {
+        long long budget = (limits.mate > 0 ? 0 : mate_check_nodes);
+        int mate_start = nodes_visited;
+        mate_solver.resize(mate_hash_mb);
+        mate = mate_solver.solve(b, mate_moves, [&]() {
+            nodes_visited++;
+            return keep_searching() && (budget == 0 || nodes_visited - mate_start < budget);
+        });
+        mate.found = mate.found && searchable(mate.pv.front());
+        if (mate.found) {
+            known_move = mate.pv.front();
+            this->best_move = known_move;
+            best_eval.check = INT_MAX;
+            best_eval.update_total();
+            pv = mate.pv;
+            depth_reached = 2 * mate.moves - 1;
+        }
+    }
+    // searches the root moves not in excluded, replacing line_eval, line_move
+    // and line_pv with the best of them that beats line_eval
+    auto search_root = [&](int depth, const vector<U16>& excluded, Evaluation& line_eval, U16& line_move, vector<U16>& line_pv) {
         int alpha = INT_MIN;
         int beta = INT_MAX;
-        for (auto iter = player_moveset.begin(); iter != player_moveset.end() && this->search; iter++) {
+        for (auto iter = player_moveset.begin(); iter != player_moveset.end() && keep_searching(); iter++) {
             auto move = *iter;
+            if (find(excluded.begin(), excluded.end(), move) != excluded.end()) continue;
+            if (nnue) {
+                nnue_update(root_acc, b, move, child_acc);
+            }
             Board* new_board = b.copy();
             new_board->do_move(move);
             visited.push_back(new_board);
             nodes_visited++;
-            Evaluation eval = minimax(*new_board, depth, false, visited, alpha, beta, this->search);
+            Evaluation eval = minimax(*new_board, depth, false, visited, alpha, beta, *this, nnue ? &child_acc : nullptr);
             eval.depth++;
             visited.pop_back();
-            if (is_better_eval(eval, best_eval, true)) {
+            if (is_better_eval(eval, line_eval, true)) {
                 for (int i = eval.moves.size() - 1; i >= 0; i--) {
                     new_board->do_move(eval.moves[i]);
                 }
+                extend_pv(*new_board, eval, depth - (int)eval.moves.size(), *this);
+                if (nnue) {
+                    nnue_refresh(*new_board, quiescence_acc);
+                }
                 nodes_visited++;
-                Evaluation new_eval = minimax(*new_board, QUIESCENCE_DEPTH, (eval.depth % 2 == 0), visited, INT_MIN, INT_MAX, this->search);
-                if (new_eval.total - eval.total >= 0 || best_eval.total == INT_MIN) {
-                    best_eval = eval;
-                    this->best_move = move;
+                STATS(int quiescence_start = nodes_visited);
+                Evaluation new_eval = minimax(*new_board, QUIESCENCE_DEPTH, (eval.depth % 2 == 0), visited, INT_MIN, INT_MAX, *this, nnue ? &quiescence_acc : nullptr, true);
+                STATS(stats.qnodes += nodes_visited - quiescence_start);
+                if (new_eval.total - eval.total >= 0 || line_eval.total == INT_MIN) {
+                    line_eval = eval;
+                    line_move = move;
                     alpha = eval.total;
+                    line_pv.assign(1, move);
+                    line_pv.insert(line_pv.end(), eval.moves.rbegin(), eval.moves.rend());
                 }
             }
             free(new_board);
         }
+    };
+    if (!known_move && backend == SEARCH_MCTS) {
+        search_mcts(*this, b, player_moveset);
+    }
+    U16 root_move = 0;
+    for (int depth = min(MIN_SEARCH_DEPTH, max_depth) - 1; !known_move && backend == SEARCH_ALPHA_BETA && depth < max_depth && keep_searching(); depth++) {
+        STATS(int iteration_start = nodes_visited);
+        vector<SearchLine> depth_lines;
+        if (workers && workers->available() && search_on_workers(*this, b, depth, player_moveset, depth_lines)) {
+            root_move = depth_lines[0].move;
+            this->best_move = root_move;
+            best_eval = Evaluation();
+            best_eval.total = depth_lines[0].score;
+            best_eval.depth = depth + 1;
+            pv = depth_lines[0].pv;
+            depth_lines.resize(min<size_t>(depth_lines.size(), max(multi_pv, 1)));
+            depth_reached = depth + 1;
+            lines.swap(depth_lines);
+            if (on_depth) {
+                search_time_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time).count();
+                on_depth();
+            }
+            STATS(stats.iteration_nodes.push_back(nodes_visited - iteration_start));
+            continue;
+        }
+        // workers busy or lost halfway leave the depth to this engine
+        if (!this->search) break;
+
+        search_root(depth, vector<U16>(), best_eval, root_move, pv);
+        this->best_move = root_move;
+
+        // the further lines share the table, so their subtrees are mostly
+        // known from the first search
+        depth_lines.assign(1, SearchLine{root_move, best_eval.total, pv});
+        vector<U16> excluded(1, root_move);
+        for (int k = 1; k < multi_pv && root_move && keep_searching(); k++) {
+            Evaluation line_eval;
+            line_eval.total = INT_MIN;
+            line_eval.depth = MAX_SEARCH_DEPTH;
+            U16 line_move = 0;
+            vector<U16> line_pv;
+            search_root(depth, excluded, line_eval, line_move, line_pv);
+            if (!line_move || !this->search) break;
+            depth_lines.push_back(SearchLine{line_move, line_eval.total, line_pv});
+            excluded.push_back(line_move);
+        }
+        if (this->search) {
+            depth_reached = depth + 1;
+            lines.swap(depth_lines);
+            if (on_depth) {
+                search_time_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time).count();
+                on_depth();
+            }
+        }
+        STATS(stats.iteration_nodes.push_back(nodes_visited - iteration_start));
+    }
+    // an interrupted depth may still have changed the best move
+    if (best_move && (lines.empty() || lines[0].move != best_move)) {
+        lines.erase(remove_if(lines.begin(), lines.end(), [&](const SearchLine& l) {
+            return l.move == best_move;
+        }), lines.end());
+        lines.insert(lines.begin(), SearchLine{best_move, best_eval.total, pv});
     }
-    auto end_time = chrono::high_resolution_clock::now();
+    auto end_time = chrono::steady_clock::now();
+    search_time_us = chrono::duration_cast<chrono::microseconds>(end_time - start_time).count();
     Board* new_board = b.copy();
     new_board->do_move(best_move);
     previous_board_occurences[board_to_str(new_board->data.board_0)]++;
     free(new_board);
-    best_eval.print();
-    cout << "found best move in " << chrono::duration_cast<chrono::duration<double>>(end_time - start_time).count() << " seconds" << endl;
-    cout << "nodes visited " << nodes_visited << endl;
+    if (verbose && book_move) {
+        cout << "book move " << move_to_str(book_move) << endl;
+    } else if (verbose && tb_move) {
+        cout << "tablebase move " << move_to_str(tb_move) << " score " << best_eval.total << endl;
+    } else if (verbose && mate.found) {
+        cout << "mate in " << mate.moves << " with " << move_to_str(mate.pv.front()) << ", " << mate.nodes << " solver nodes" << endl;
+    } else if (verbose) {
+        best_eval.print();
+        cout << "found best move in " << chrono::duration_cast<chrono::duration<double>>(end_time - start_time).count() << " seconds" << endl;
+        cout << "nodes visited " << nodes_visited << endl;
+    }
 }
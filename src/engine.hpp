@@ -1,7 +1,121 @@
 #pragma once
 
-#include "board.hpp"
+// board.hpp defines a move() macro, which clashes with std::move in the
+// standard headers if they are first included after it
+#pragma push_macro("move")
+#undef move
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+#include "mate.hpp"
+#include "mcts.hpp"
+#include "stats.hpp"
+#include "tt.hpp"
+
+class OpeningBook;
+class Tablebases;
+
+struct Evaluation {
+    int piece_weight    = 0;
+    int promo           = 0;
+    int check           = 0;
+    int king_distance   = 0;
+    int depth           = 0;
+    int attack          = 0;
+    int ring_weight     = 0;
+    int nnue            = 0;
+    int tablebase       = 0;
+    int total           = 0;
+    std::vector<U16> moves;
+
+    void reset() {
+        piece_weight    = 0;
+        promo           = 0;
+        attack          = 0;
+        check           = 0;
+        king_distance   = 0;
+        ring_weight     = 0;
+        nnue            = 0;
+        tablebase       = 0;
+        total           = 0;
+    }
+
+    void update_total() {
+        total = 0;
+        total += piece_weight;
+        total += attack;
+        total += promo;
+        total += check;
+        total += king_distance;
+        total += ring_weight;
+        total += nnue;
+        total += tablebase;
+    }
+
+    void print();
+};
+
+// Limits for a single find_best_move call, 0 meaning no limit. depth is
+// counted in plies from the root. mate, if set, first looks for a mate in
+// that many moves with the mate solver, and only searches if there is none.
+// searchmoves, if not empty, are the only root moves considered.
+struct SearchLimits {
+    int depth       = 0;
+    int nodes       = 0;
+    int movetime_ms = 0;
+    int mate        = 0;
+    std::vector<U16> searchmoves;
+};
+
+// Score of a root move searched by a RootSplitter, from the root player's
+// point of view, with its principal variation starting with the move
+struct RootResult {
+    bool done = false;
+    int score = 0;
+    std::vector<U16> pv;
+    long long nodes = 0;
+};
+
+// Searches root moves outside the engine, such as the WorkerPool of
+// workers.hpp does on other processes
+class RootSplitter {
+
+    public:
+    virtual ~RootSplitter() = default;
+
+    // false while nothing could search, and the engine has to itself
+    virtual bool available() = 0;
+
+    // Scores every move of b, each searched to depth plies counting the
+    // move, with the positions in repeated (as board_to_str) having already
+    // occurred twice. Returns false unless all of them were done before
+    // keep_searching returned false, and at once if another search has the
+    // splitter, without waiting for it.
+    virtual bool search(const Board& b, const std::vector<std::string>& repeated, const std::vector<U16>& moves,
+                        int depth, const std::function<bool()>& keep_searching, std::vector<RootResult>& results) = 0;
+};
+
+enum SearchBackend {
+    SEARCH_ALPHA_BETA,
+    SEARCH_MCTS
+};
+
+// "alphabeta" or "mcts", as the binaries' --search options take them
+bool str_to_backend(const std::string& name, SearchBackend& backend);
+
+// One root move of a MultiPV search, with its score from the root player's
+// point of view and its principal variation, starting with move
+struct SearchLine {
+    U16 move = 0;
+    int score = 0;
+    std::vector<U16> pv;
+};
 
 class Engine {
 
@@ -9,5 +123,89 @@ class Engine {
     std::atomic<U16> best_move;
     std::atomic<bool> search;
 
+    SearchLimits limits;
+    bool verbose = true;
+    // evaluate leaves with the network from nnue_load instead of eval, if
+    // one was loaded
+    bool use_nnue = false;
+    // if set, positions in the book are played from it without searching
+    const OpeningBook* book = nullptr;
+    // if set, positions they cover are scored exactly in the search, and
+    // played from them at the root
+    const Tablebases* tablebases = nullptr;
+    // size of the transposition table, which is kept between searches
+    size_t hash_mb = 16;
+    TranspositionTable tt;
+    // if set, every search first spends up to mate_check_nodes on looking
+    // for a mate in this many moves, which is played without searching
+    int mate_check = 0;
+    long long mate_check_nodes = 2000;
+    // size of the solver's own table, kept between searches as well; it is
+    // only allocated once a mate check or go mate runs, on top of hash_mb
+    size_t mate_hash_mb = 4;
+    MateSolver mate_solver;
+    // number of best root moves to find; each depth searches the root again
+    // for every further one, without the moves already found
+    int multi_pv = 1;
+    // if set, called after every fully searched depth
+    std::function<void()> on_depth;
+    // if set and available, root moves are searched on it rather than here,
+    // each depth being finished before the next one starts
+    RootSplitter* workers = nullptr;
+    // the search run once the book, tablebases and mate check had no move;
+    // MCTS ignores workers, takes limits.depth without nodes as a budget of
+    // MCTS_SIMULATIONS_PER_DEPTH simulations a ply, and sizes its tree with
+    // hash_mb like the table
+    SearchBackend backend = SEARCH_ALPHA_BETA;
+    MctsSearch mcts;
+
+    // result of the last search: the leaf evaluation of the principal
+    // variation, the variation itself starting with best_move, and the last
+    // fully searched depth
+    Evaluation best_eval;
+    std::vector<U16> pv;
+    int depth_reached = 0;
+    // the multi_pv best root moves, best first; lines[0] is best_move
+    std::vector<SearchLine> lines;
+    long long search_time_us = 0;
+    SearchStats stats;
+
+    // per-game search state, so that several engines can share a process
+    int curr_player = -1;
+    int nodes_visited = 0;
+    std::unordered_map<std::string, int> previous_board_occurences;
+    std::chrono::steady_clock::time_point start_time;
+
     virtual void find_best_move(const Board& b);
+
+    // false once the search was stopped or ran into one of its limits
+    bool keep_searching();
+
+    // Identifies what the table's scores depend on: the eval weights and
+    // the network, if it is used
+    U64 tt_fingerprint() const;
+    // The table saved to and loaded from a file; a table saved by an engine
+    // with another fingerprint is not loaded
+    bool save_tt(const std::string& path) const;
+    bool load_tt(const std::string& path);
+    // Shares the table of the POSIX shared memory object name with the
+    // other engines attached to it, in this process or others, creating it
+    // with hash_mb megabytes if needed
+    bool attach_tt(const std::string& name);
+
+    // the last search as a UCI info line, for one of its lines, and as one
+    // JSON object; the SearchStats counters are included in builds that
+    // have them
+    std::string uci_info(size_t line = 0) const;
+    std::string stats_json() const;
 };
+
+// Static evaluation of b from the point of view of the side to move
+int evaluate(const Board& b);
+
+// Static exchange evaluation of move: the material it wins for the side
+// making it once both sides have recaptured on its square, least valuable
+// piece first, for as long as that pays. Recaptures come from the move
+// generator, so ring reflections, pieces uncovered behind a capture and
+// promotions are accounted for; pins are not.
+int see(const Board& b, U16 move);
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <climits>
+#include <sstream>
+
+using namespace std;
+
+#include "board.hpp"
+#include "engine.hpp"
+
+// The members of Engine, and the --search and --mcts-leaf parsers, that do
+// not depend on how it searches, shared by
+// engine.cpp and the Python engine of engine_py.cpp, which each define
+// tt_fingerprint
+
+bool str_to_backend(const string& name, SearchBackend& backend) {
+    if (name == "alphabeta") backend = SEARCH_ALPHA_BETA;
+    else if (name == "mcts") backend = SEARCH_MCTS;
+    else return false;
+    return true;
+}
+
+bool str_to_mcts_leaf(const string& name, MctsLeaf& leaf) {
+    if (name == "eval") leaf = MCTS_EVAL;
+    else if (name == "playout") leaf = MCTS_PLAYOUT;
+    else return false;
+    return true;
+}
+
+bool Engine::keep_searching() {
+    if (limits.nodes > 0 && nodes_visited >= limits.nodes) {
+        search = false;
+    } else if (limits.movetime_ms > 0 && (nodes_visited & 0xff) == 0
+               && chrono::steady_clock::now() - start_time >= chrono::milliseconds(limits.movetime_ms)) {
+        search = false;
+    }
+    return search;
+}
+
+bool Engine::save_tt(const string& path) const {
+    return tt.save(path, tt_fingerprint());
+}
+
+bool Engine::load_tt(const string& path) {
+    tt.resize(hash_mb);
+    return tt.load(path, tt_fingerprint());
+}
+
+bool Engine::attach_tt(const string& name) {
+    return tt.attach(name, hash_mb, tt_fingerprint());
+}
+
+string Engine::uci_info(size_t line) const {
+
+    // lines other than the first only have a score and a variation
+    int score = (line > 0 && line < lines.size() ? lines[line].score : best_eval.total);
+    const vector<U16>& line_pv = (line > 0 && line < lines.size() ? lines[line].pv : pv);
+
+    ostringstream info;
+    long long nps = (search_time_us > 0 ? nodes_visited * 1000000LL / search_time_us : 0);
+    info << "info depth " << depth_reached;
+    if (multi_pv > 1) {
+        info << " multipv " << line + 1;
+    }
+    if (score == INT_MAX || score == INT_MIN) {
+        int moves = (line_pv.size() + 1) / 2;
+        info << " score mate " << (score == INT_MAX ? moves : -moves);
+    } else {
+        info << " score cp " << score;
+    }
+    info << " nodes " << nodes_visited << " time " << search_time_us / 1000 << " nps " << nps;
+#ifdef SEARCH_STATS
+    info << " tbhits " << stats.tb_hits;
+#endif
+    info << " pv";
+    for (U16 m : line_pv) {
+        info << ' ' << move_to_str(m);
+    }
+#ifdef SEARCH_STATS
+    // string takes the rest of the line, so it goes last
+    double first_move_rate = (stats.cutoffs ? (double)stats.first_move_cutoffs / stats.cutoffs : 0);
+    size_t n = stats.iteration_nodes.size();
+    double ebf = (n >= 2 && stats.iteration_nodes[n-2] ? (double)stats.iteration_nodes[n-1] / stats.iteration_nodes[n-2] : 0);
+    long long search_us = search_time_us - (stats.movegen_ns + stats.eval_ns) / 1000;
+    info << " string qnodes " << stats.qnodes
+         << " tthits " << stats.tt_hits << " ttcutoffs " << stats.tt_cutoffs
+         << " cutoffs " << stats.cutoffs << " firstmove " << first_move_rate << " ebf " << ebf
+         << " movegen_ms " << stats.movegen_ns / 1000000 << " eval_ms " << stats.eval_ns / 1000000
+         << " search_ms " << search_us / 1000;
+#endif
+    return info.str();
+}
+
+string Engine::stats_json() const {
+
+    ostringstream json;
+    long long nps = (search_time_us > 0 ? nodes_visited * 1000000LL / search_time_us : 0);
+    json << "{\"move\":\"" << move_to_str(best_move) << "\""
+         << ",\"depth\":" << depth_reached
+         << ",\"score\":" << best_eval.total
+         << ",\"nodes\":" << nodes_visited
+         << ",\"time_us\":" << search_time_us
+         << ",\"nps\":" << nps;
+#ifdef SEARCH_STATS
+    json << ",\"qnodes\":" << stats.qnodes
+         << ",\"tb_hits\":" << stats.tb_hits
+         << ",\"tt_hits\":" << stats.tt_hits
+         << ",\"tt_cutoffs\":" << stats.tt_cutoffs
+         << ",\"cutoffs\":" << stats.cutoffs
+         << ",\"first_move_cutoffs\":" << stats.first_move_cutoffs
+         << ",\"movegen_us\":" << stats.movegen_ns / 1000
+         << ",\"eval_us\":" << stats.eval_ns / 1000
+         << ",\"iteration_nodes\":[";
+    for (size_t i = 0; i < stats.iteration_nodes.size(); i++) {
+        json << (i ? "," : "") << stats.iteration_nodes[i];
+    }
+    json << "]";
+#endif
+    json << "}";
+    return json.str();
+}
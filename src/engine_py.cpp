@@ -1,54 +1,88 @@
 #include <algorithm>
+#include <chrono>
 #include <random>
 #include <iostream>
 
 #include "board.hpp"
 #include "engine.hpp"
+#include "engine_py.hpp"
 
-#ifdef move
+#pragma push_macro("move")
+#pragma push_macro("pos")
 #undef move
-#define MOVE_WAS_DEFINED
-#endif
-
-#ifdef pos
 #undef pos
-#define POS_WAS_DEFINED
-#endif
-
 #include <pybind11/pybind11.h>
 #include <pybind11/embed.h>
+#pragma pop_macro("pos")
+#pragma pop_macro("move")
 
-#ifdef MOVE_WAS_DEFINED
-#define move
-#undef MOVE_WAS_DEFINED
-#endif
+namespace py = pybind11;
 
-#ifdef POS_WAS_DEFINED
-#define pos
-#undef POS_WAS_DEFINED
-#endif
+// The engine searching on this thread, if any, for the rollerball module
+thread_local Engine* current_engine = nullptr;
 
-namespace py = pybind11;
+// Lets engine.py cooperate with the server: searching() turns false once
+// `stop` arrives or the movetime is up, and set_best_move() records a move to
+// fall back on if the search is cut short.
+PYBIND11_EMBEDDED_MODULE(rollerball, m) {
+    m.def("searching", []() {
+        // nodes_visited stays 0, so keep_searching checks the time every call
+        return current_engine != nullptr && current_engine->keep_searching();
+    });
+    m.def("set_best_move", [](U16 m) {
+        if (current_engine != nullptr) current_engine->best_move = m;
+    });
+}
+
+// The interpreter is started once and kept for the lifetime of the process,
+// with engine.find_best_move looked up a single time. It is never finalized,
+// as the search threads may still hold references into it at exit.
+struct PythonEngine {
+
+    py::object find_best_move;
+
+    PythonEngine() {
+        py::initialize_interpreter();
+        try {
+            find_best_move = py::module::import("engine").attr("find_best_move");
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error loading engine.py: " << e.what() << std::endl;
+        }
 
+        // release the GIL so that search threads can take it per call
+        PyEval_SaveThread();
+    }
+};
+
+PythonEngine& python_engine() {
+    static PythonEngine* engine = new PythonEngine();
+    return *engine;
+}
+
+void start_python_engine() {
+    python_engine();
+}
+
+// engine.py does not use the table, so nothing of it changes what a saved one
+// holds
+U64 Engine::tt_fingerprint() const {
+    return 0;
+}
 
 void Engine::find_best_move(const Board& b) {
-    // py::scoped_interpreter guard{};  // Start the Python interpreter
-    py::scoped_interpreter guard{};  // Start the Python interpreter
-
-    std::cout << "Starting Best Move" << std::endl;
-    std::cout << "Loading Module" << std::endl;
-    
-    std::cout << "Module almost Loaded" << std::endl;
-    py::module my_module;
-    try{
-        my_module = py::module::import("engine");
-    }catch(const std::exception& e){
-        std::cout << "Error: " << e.what() << std::endl;
+
+    start_time = std::chrono::steady_clock::now();
+    PythonEngine& python = python_engine();
+    if (!python.find_best_move) return;
+
+    py::gil_scoped_acquire gil;
+    current_engine = this;
+    try {
+        this->best_move = python.find_best_move(b).cast<U16>();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error in engine.find_best_move: " << e.what() << std::endl;
     }
-    
-    std::cout << "Module Loaded" << std::endl;
-    py::object find_best_move_func = my_module.attr("find_best_move");
-    std::cout << "In find_best_move" << std::endl;
-    this->best_move = find_best_move_func(b).cast<int>();
-    std::cout << "Best Move Found" << std::endl;
-}
\ No newline at end of file
+    current_engine = nullptr;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Starts the embedded interpreter of bin/rollerball_py and imports engine.py,
+// once main has parsed its options and before any search
+void start_python_engine();
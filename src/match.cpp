@@ -0,0 +1,168 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "engine.hpp"
+#include "selfplay.hpp"
+
+// Headless self-play: plays pairs of games between two engine configurations
+// from random openings, once with each colour, and reports the score of the
+// first engine with Elo and SPRT statistics.
+
+struct MatchStats {
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+
+    int games() const { return wins + draws + losses; }
+
+    double score() const {
+        return (wins + 0.5 * draws) / games();
+    }
+
+    // variance of a single game's result
+    double variance() const {
+        double s = score();
+        return (wins * (1-s) * (1-s) + draws * (0.5-s) * (0.5-s) + losses * s * s) / games();
+    }
+};
+
+double elo_to_score(double elo) {
+    return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+double score_to_elo(double score) {
+    score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+}
+
+// Log likelihood ratio of elo1 against elo0, using the normal approximation
+// to the trinomial game result distribution
+double sprt_llr(const MatchStats& stats, double elo0, double elo1) {
+    double var = stats.variance();
+    if (stats.games() == 0 || var == 0) return 0;
+    double s0 = elo_to_score(elo0);
+    double s1 = elo_to_score(elo1);
+    return (s1 - s0) * (2 * stats.score() - s0 - s1) / (2 * var) * stats.games();
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball self-play match");
+    int games, concurrency, opening_plies, max_moves, seed;
+    SearchLimits limits[2];
+    std::string search[2], mcts_leaf;
+    double elo0, elo1, alpha, beta;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    op.add<popl::Value<int>>("n", "games", "number of games, played in pairs with colours swapped", 100, &games);
+    op.add<popl::Value<int>>("c", "concurrency", "games played in parallel", std::thread::hardware_concurrency(), &concurrency);
+    op.add<popl::Value<int>>("", "depth1", "depth limit of the first engine, in plies", 3, &limits[0].depth);
+    op.add<popl::Value<int>>("", "nodes1", "node limit of the first engine", 0, &limits[0].nodes);
+    op.add<popl::Value<int>>("", "movetime1", "time limit of the first engine, in ms", 0, &limits[0].movetime_ms);
+    op.add<popl::Value<std::string>>("", "search1", "search backend of the first engine, alphabeta or mcts", "alphabeta", &search[0]);
+    op.add<popl::Value<int>>("", "depth2", "depth limit of the second engine, in plies", 3, &limits[1].depth);
+    op.add<popl::Value<int>>("", "nodes2", "node limit of the second engine", 0, &limits[1].nodes);
+    op.add<popl::Value<int>>("", "movetime2", "time limit of the second engine, in ms", 0, &limits[1].movetime_ms);
+    op.add<popl::Value<std::string>>("", "search2", "search backend of the second engine, alphabeta or mcts", "alphabeta", &search[1]);
+    op.add<popl::Value<std::string>>("", "mcts-leaf", "how MCTS scores the leaves it expands, eval or playout", "eval", &mcts_leaf);
+    op.add<popl::Value<int>>("", "opening-plies", "random plies played before the engines take over", 4, &opening_plies);
+    op.add<popl::Value<int>>("", "max-moves", "moves per side before the game is drawn", 100, &max_moves);
+    op.add<popl::Value<int>>("", "seed", "seed for the random openings", 1, &seed);
+    op.add<popl::Value<double>>("", "elo0", "SPRT null hypothesis", 0, &elo0);
+    op.add<popl::Value<double>>("", "elo1", "SPRT alternative hypothesis", 5, &elo1);
+    op.add<popl::Value<double>>("", "alpha", "SPRT false positive rate", 0.05, &alpha);
+    op.add<popl::Value<double>>("", "beta", "SPRT false negative rate", 0.05, &beta);
+    auto sprt_op = op.add<popl::Switch>("", "sprt", "stop as soon as the SPRT reaches a decision");
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    SearchBackend backends[2];
+    MctsLeaf leaf;
+    for (int i = 0; i < 2; i++) {
+        if (!str_to_backend(search[i], backends[i])) {
+            std::cout << "ERROR: unknown search " << search[i] << std::endl;
+            return 1;
+        }
+    }
+    if (!str_to_mcts_leaf(mcts_leaf, leaf)) {
+        std::cout << "ERROR: unknown MCTS leaf evaluation " << mcts_leaf << std::endl;
+        return 1;
+    }
+
+    double lower = std::log(beta / (1 - alpha));
+    double upper = std::log((1 - beta) / alpha);
+
+    MatchStats stats;
+    std::mutex stats_mutex;
+    std::atomic<int> next_game(0);
+    std::atomic<bool> stopped(false);
+
+    auto worker = [&]() {
+        for (int g = next_game++; g < games && !stopped; g = next_game++) {
+            // both games of a pair start from the same opening
+            std::mt19937 rng(seed + g / 2);
+            Board opening = random_opening(opening_plies, rng);
+
+            // the first engine plays white in even games
+            bool first_is_white = (g % 2 == 0);
+            auto setup = [&](Engine& e, PlayerColor color) {
+                e.backend = backends[(color == WHITE) == first_is_white ? 0 : 1];
+                e.mcts.leaf = leaf;
+            };
+            GameOutcome outcome = play_game(opening, limits[first_is_white ? 0 : 1], limits[first_is_white ? 1 : 0], max_moves, nullptr, setup);
+            int result = (first_is_white ? outcome.result : -outcome.result);
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            if      (result > 0) stats.wins++;
+            else if (result < 0) stats.losses++;
+            else                 stats.draws++;
+
+            double llr = sprt_llr(stats, elo0, elo1);
+            std::cout << "game " << g + 1 << ": "
+                      << (result > 0 ? "1-0" : result < 0 ? "0-1" : "1/2") << " (" << outcome.reason << ", " << outcome.moves.size() << " plies)"
+                      << "  W/D/L " << stats.wins << "/" << stats.draws << "/" << stats.losses
+                      << "  LLR " << llr << std::endl;
+
+            if (sprt_op->is_set() && (llr <= lower || llr >= upper)) {
+                stopped = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::max(concurrency, 1); i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    if (stats.games() == 0) return 0;
+
+    double s = stats.score();
+    double margin = 1.96 * std::sqrt(stats.variance() / stats.games());
+    double llr = sprt_llr(stats, elo0, elo1);
+
+    std::cout << "\nGames: " << stats.games()
+              << "  W: " << stats.wins << "  D: " << stats.draws << "  L: " << stats.losses << '\n';
+    std::cout << "Score: " << 100 * s << "%"
+              << "  Elo: " << score_to_elo(s)
+              << " [" << score_to_elo(s - margin) << ", " << score_to_elo(s + margin) << "]\n";
+    std::cout << "SPRT elo0=" << elo0 << " elo1=" << elo1
+              << "  LLR: " << llr << " [" << lower << ", " << upper << "]  "
+              << (llr >= upper ? "H1 accepted" : llr <= lower ? "H0 accepted" : "no decision") << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <algorithm>
+
+#include "mate.hpp"
+
+// proof or disproof number of a settled position
+const uint32_t DFPN_INF = 100000000;
+
+void MateSolver::resize(size_t mb) {
+
+    size_t n = 1;
+    while (2 * n * sizeof(Entry) <= mb * 1024 * 1024) {
+        n *= 2;
+    }
+    if (n == table.size()) return;
+
+    std::vector<Entry> resized(n);
+    table.swap(resized);
+}
+
+void MateSolver::clear() {
+    std::fill(table.begin(), table.end(), Entry());
+}
+
+U64 MateSolver::key(const Board& b, int plies) const {
+    // the same position with a different number of plies left is another problem
+    return b.canonical_hash() ^ (0x9e3779b97f4a7c15ULL * (plies + 1));
+}
+
+void MateSolver::lookup(const Board& b, int plies, uint32_t& pn, uint32_t& dn) const {
+    const Entry& e = table[key(b, plies) & (table.size() - 1)];
+    if (e.key == key(b, plies)) {
+        pn = e.pn;
+        dn = e.dn;
+    } else {
+        pn = 1;
+        dn = 1;
+    }
+}
+
+void MateSolver::store(const Board& b, int plies, uint32_t pn, uint32_t dn) {
+    Entry& e = table[key(b, plies) & (table.size() - 1)];
+    e.key = key(b, plies);
+    e.pn = pn;
+    e.dn = dn;
+}
+
+// Searches b until its proof number reaches pn_threshold or its disproof
+// number dn_threshold. The attacker is to play when an odd number of plies
+// is left.
+void MateSolver::mid(const Board& b, int plies, uint32_t pn_threshold, uint32_t dn_threshold) {
+
+    if (!(*keep_searching)()) {
+        stopped = true;
+        return;
+    }
+    nodes++;
+
+    bool attacker = (plies % 2 == 1);
+    auto moves = b.get_sorted_legal_moves();
+    if (moves.empty()) {
+        bool mated = !attacker && b.in_check();
+        store(b, plies, mated ? 0 : DFPN_INF, mated ? DFPN_INF : 0);
+        return;
+    }
+    if (plies == 0) {
+        // the defender is still alive when the moves run out
+        store(b, plies, DFPN_INF, 0);
+        return;
+    }
+
+    std::vector<Board> children(moves.size(), b);
+    for (size_t i = 0; i < moves.size(); i++) {
+        children[i].do_move(moves[i]);
+    }
+    path.push_back(b.hash());
+
+    while (true) {
+        // an OR node is as close to a proof as its best move and needs all
+        // of them disproven, an AND node the other way round
+        uint64_t sum = 0;
+        uint32_t best = DFPN_INF, second = DFPN_INF;
+        uint32_t best_pn = 0, best_dn = 0;
+        size_t best_child = 0;
+        for (size_t i = 0; i < children.size(); i++) {
+            uint32_t pn, dn;
+            if (std::find(path.begin(), path.end(), children[i].hash()) != path.end()) {
+                // repetitions never mate
+                pn = DFPN_INF;
+                dn = 0;
+            } else {
+                lookup(children[i], plies - 1, pn, dn);
+            }
+            uint32_t select = (attacker ? pn : dn);
+            sum += (attacker ? dn : pn);
+            if (select < best) {
+                second = best;
+                best = select;
+                best_child = i;
+                best_pn = pn;
+                best_dn = dn;
+            } else if (select < second) {
+                second = select;
+            }
+        }
+        uint32_t total = (uint32_t)std::min<uint64_t>(sum, DFPN_INF);
+        uint32_t pn = (attacker ? best : total);
+        uint32_t dn = (attacker ? total : best);
+
+        if (pn >= pn_threshold || dn >= dn_threshold || stopped) {
+            store(b, plies, pn, dn);
+            break;
+        }
+
+        uint32_t child_pn_threshold, child_dn_threshold;
+        if (attacker) {
+            child_pn_threshold = std::min<uint32_t>(pn_threshold, second + 1);
+            child_dn_threshold = (uint32_t)std::min<uint64_t>((uint64_t)dn_threshold - dn + best_dn, DFPN_INF);
+        } else {
+            child_pn_threshold = (uint32_t)std::min<uint64_t>((uint64_t)pn_threshold - pn + best_pn, DFPN_INF);
+            child_dn_threshold = std::min<uint32_t>(dn_threshold, second + 1);
+        }
+        mid(children[best_child], plies - 1, child_pn_threshold, child_dn_threshold);
+    }
+
+    path.pop_back();
+}
+
+MateResult MateSolver::solve(const Board& b, int max_moves, const std::function<bool()>& keep_searching) {
+
+    MateResult result;
+    if (table.empty()) resize(16);
+    this->keep_searching = &keep_searching;
+    nodes = 0;
+    stopped = false;
+
+    // shortest first, so the first proof is the fastest mate
+    for (int moves = 1; moves <= max_moves && !stopped; moves++) {
+        int plies = 2 * moves - 1;
+        uint32_t pn, dn;
+        do {
+            path.clear();
+            mid(b, plies, DFPN_INF, DFPN_INF);
+            lookup(b, plies, pn, dn);
+        } while (pn != 0 && dn != 0 && !stopped);
+
+        if (pn != 0) continue;
+
+        result.moves = moves;
+        // follow proven moves; the defender's are all proven, so it takes
+        // the one the table does not also prove with fewer plies
+        Board c = b;
+        for (int left = plies; left > 0; left--) {
+            U16 next = 0;
+            int longest = -1;
+            for (U16 m : c.get_sorted_legal_moves()) {
+                Board child = c;
+                child.do_move(m);
+                uint32_t child_pn, child_dn;
+                lookup(child, left - 1, child_pn, child_dn);
+                if (child_pn != 0) continue;
+
+                int shortest = left - 1;
+                for (int k = left - 3; k > 0 && left % 2 == 0; k -= 2) {
+                    lookup(child, k, child_pn, child_dn);
+                    if (child_pn != 0) break;
+                    shortest = k;
+                }
+                if (shortest > longest) {
+                    next = m;
+                    longest = shortest;
+                }
+                if (left % 2 == 1) break;
+            }
+            if (!next) break;
+            result.pv.push_back(next);
+            c.do_move(next);
+        }
+        // without its first move, the proof was overwritten in the table
+        result.found = !result.pv.empty();
+        break;
+    }
+
+    result.nodes = nodes;
+    this->keep_searching = nullptr;
+    return result;
+}
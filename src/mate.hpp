@@ -0,0 +1,56 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <cstdint>
+#include <functional>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Mate solver using depth-first proof-number search (df-pn). The side to play
+// at the root is the attacker, and a position is proven when it mates within
+// the move limit against any defence, disproven when it cannot. Proof and
+// disproof numbers are kept in the solver's own fixed-size table, keyed by
+// Board::canonical_hash and the plies left, so it runs in bounded memory:
+// entries that get overwritten are simply searched again.
+
+struct MateResult {
+    bool found = false;
+    int moves = 0;              // mate in this many moves of the attacker
+    std::vector<U16> pv;
+    long long nodes = 0;
+};
+
+class MateSolver {
+
+    public:
+    // Sizes the table like TranspositionTable::resize
+    void resize(size_t mb);
+    void clear();
+
+    // The shortest mate in at most max_moves moves for the side to play in
+    // b. keep_searching is called once per node, and the solver gives up as
+    // soon as it returns false.
+    MateResult solve(const Board& b, int max_moves, const std::function<bool()>& keep_searching);
+
+    private:
+    struct Entry {
+        U64 key = 0;
+        uint32_t pn = 1;
+        uint32_t dn = 1;
+    };
+
+    std::vector<Entry> table;
+    // positions on the current line, which a move may not repeat
+    std::vector<U64> path;
+    const std::function<bool()> *keep_searching = nullptr;
+    long long nodes = 0;
+    bool stopped = false;
+
+    U64 key(const Board& b, int plies) const;
+    void lookup(const Board& b, int plies, uint32_t& pn, uint32_t& dn) const;
+    void store(const Board& b, int plies, uint32_t pn, uint32_t dn);
+    void mid(const Board& b, int plies, uint32_t pn_threshold, uint32_t dn_threshold);
+};
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <thread>
+
+#include "mcts.hpp"
+#include "engine.hpp"
+#include "nnue.hpp"
+#include "tablebase.hpp"
+
+const int MCTS_VIRTUAL_LOSS = 3;
+const int MCTS_PLAYOUT_PLIES = 16;
+const int64_t MCTS_VALUE_ONE = 1 << 16;
+// centipawns of eval and see() per unit of the logistic that turns them into
+// values and priors
+const double MCTS_EVAL_SCALE = 400;
+const double MCTS_PRIOR_SCALE = 200;
+// reported scores stop at the centipawns of this value and its complement
+const double MCTS_MIN_VALUE = 1e-4;
+
+enum NodeState : uint8_t { NODE_LEAF, NODE_EXPANDING, NODE_EXPANDED };
+
+double cp_to_value(double cp) {
+    return 1 / (1 + std::exp(-cp / MCTS_EVAL_SCALE));
+}
+
+int value_to_cp(double value) {
+    value = std::min(std::max(value, MCTS_MIN_VALUE), 1 - MCTS_MIN_VALUE);
+    return (int)std::lround(-MCTS_EVAL_SCALE * std::log(1 / value - 1));
+}
+
+// Value of b for the side to play, from the network or eval
+double static_value(const Board& b, bool use_nnue) {
+    if (use_nnue) {
+        NnueAccumulator acc;
+        nnue_refresh(b, acc);
+        return cp_to_value(nnue_evaluate(acc, b.data.player_to_play));
+    }
+    return cp_to_value(evaluate(b));
+}
+
+void MctsSearch::resize(size_t mb) {
+    // first_child indexes the arena in 32 bits
+    size_t n = std::max<size_t>(mb * 1024 * 1024 / sizeof(Node), 1024);
+    n = std::min<size_t>(n, UINT32_MAX);
+    if (n != capacity) {
+        nodes.reset(new Node[n]);
+        capacity = n;
+    }
+}
+
+bool MctsSearch::expand(Node& node, const Board& b, const std::vector<U16>& moves) {
+
+    uint8_t expected = NODE_LEAF;
+    if (!node.state.compare_exchange_strong(expected, NODE_EXPANDING)) return false;
+
+    size_t first = used.fetch_add(moves.size());
+    if (first + moves.size() > capacity) {
+        full = true;
+        node.state.store(NODE_LEAF);
+        return false;
+    }
+
+    // moves that win material, or at least do not lose the piece, first
+    std::vector<double> priors(moves.size());
+    double sum = 0;
+    for (size_t i = 0; i < moves.size(); i++) {
+        priors[i] = std::exp(see(b, moves[i]) / MCTS_PRIOR_SCALE);
+        sum += priors[i];
+    }
+    for (size_t i = 0; i < moves.size(); i++) {
+        Node& child = nodes[first + i];
+        child.move = moves[i];
+        child.n_children = 0;
+        child.first_child = 0;
+        child.prior = priors[i] / sum;
+        child.state.store(NODE_LEAF, std::memory_order_relaxed);
+        child.visits.store(0, std::memory_order_relaxed);
+        child.value.store(0, std::memory_order_relaxed);
+    }
+    node.first_child = first;
+    node.n_children = moves.size();
+    node.state.store(NODE_EXPANDED, std::memory_order_release);
+    return true;
+}
+
+MctsSearch::Node* MctsSearch::select(Node& parent) const {
+
+    int32_t parent_visits = parent.visits.load(std::memory_order_relaxed);
+    double sqrt_visits = std::sqrt((double)std::max(parent_visits, 1));
+    // moves not tried yet start from the parent's value for the player
+    // choosing between them
+    double unvisited = (parent_visits > 0 ? 1 - (double)parent.value.load(std::memory_order_relaxed) / MCTS_VALUE_ONE / parent_visits : 0.5);
+
+    Node* best = nullptr;
+    double best_score = -1;
+    for (size_t i = 0; i < parent.n_children; i++) {
+        Node& child = nodes[parent.first_child + i];
+        int32_t visits = child.visits.load(std::memory_order_relaxed);
+        double q = (visits > 0 ? (double)child.value.load(std::memory_order_relaxed) / MCTS_VALUE_ONE / visits : unvisited);
+        double score = q + exploration * child.prior * sqrt_visits / (1 + visits);
+        if (score > best_score) {
+            best = &child;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+double MctsSearch::score_leaf(const Board& b, bool use_nnue, std::mt19937_64& rng) const {
+
+    if (leaf == MCTS_EVAL) return static_value(b, use_nnue);
+
+    Board c = b;
+    bool flipped = false;
+    for (int ply = 0; ply < MCTS_PLAYOUT_PLIES; ply++) {
+        auto moves = c.get_sorted_legal_moves();
+        if (moves.empty()) {
+            double value = (c.in_check() ? 0 : 0.5);
+            return flipped ? 1 - value : value;
+        }
+        c.do_move(moves[rng() % moves.size()]);
+        flipped = !flipped;
+    }
+    double value = static_value(c, use_nnue);
+    return flipped ? 1 - value : value;
+}
+
+long long MctsSearch::search(const Board& b, const std::vector<U16>& moves, bool use_nnue,
+                             const std::unordered_map<std::string, int>& occurences, const Tablebases* tablebases,
+                             const std::function<bool(long long)>& keep_searching) {
+
+    if (moves.empty() || capacity < moves.size() + 1) return 0;
+
+    Node& root = nodes[0];
+    root.state.store(NODE_LEAF);
+    root.visits.store(0);
+    root.value.store(0);
+    used = 1;
+    full = false;
+    expand(root, b, moves);
+
+    // path is the simulation's own buffer, to save an allocation per call
+    auto simulate = [&](std::vector<Node*>& path, std::mt19937_64& rng) {
+        Board board = b;
+        Node* node = &root;
+        path.assign(1, node);
+        node->visits.fetch_add(MCTS_VIRTUAL_LOSS, std::memory_order_relaxed);
+        while (node->state.load(std::memory_order_acquire) == NODE_EXPANDED) {
+            node = select(*node);
+            board.do_move(node->move);
+            node->visits.fetch_add(MCTS_VIRTUAL_LOSS, std::memory_order_relaxed);
+            path.push_back(node);
+        }
+
+        // value for the side to play on board; repetitions and stalemates
+        // are draws, as in play_game
+        double value;
+        auto it = occurences.find(board_to_str(board.data.board_0));
+        TBResult tb;
+        if (it != occurences.end() && it->second == 2) {
+            value = 0.5;
+        } else if (tablebases && tablebases->probe(board, tb)) {
+            value = (tb.result > 0 ? 1 : tb.result < 0 ? 0 : 0.5);
+        } else {
+            auto leaf_moves = board.get_sorted_legal_moves();
+            if (leaf_moves.empty()) {
+                value = (board.in_check() ? 0 : 0.5);
+            } else {
+                expand(*node, board, leaf_moves);
+                value = score_leaf(board, use_nnue, rng);
+            }
+        }
+
+        // every node keeps the results of the player who moved into it,
+        // and its virtual losses are replaced by the real result
+        double result = 1 - value;
+        for (auto n = path.rbegin(); n != path.rend(); n++) {
+            (*n)->value.fetch_add(std::llround(result * MCTS_VALUE_ONE), std::memory_order_relaxed);
+            (*n)->visits.fetch_add(1 - MCTS_VIRTUAL_LOSS, std::memory_order_relaxed);
+            result = 1 - result;
+        }
+    };
+
+    std::atomic<long long> simulations(0);
+    std::atomic<bool> stopped(false);
+    auto run = [&](int index) {
+        std::mt19937_64 rng(index + 1);
+        std::vector<Node*> path;
+        while (!stopped.load(std::memory_order_relaxed) && !full.load(std::memory_order_relaxed)) {
+            simulate(path, rng);
+            long long n = simulations.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (index == 0 && !keep_searching(n)) stopped = true;
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads; i++) {
+        helpers.emplace_back(run, i);
+    }
+    run(0);
+    stopped = true;
+    for (auto& t : helpers) {
+        t.join();
+    }
+    return simulations;
+}
+
+std::vector<U16> MctsSearch::line(const Node& node) const {
+
+    std::vector<U16> pv(1, node.move);
+    const Node* n = &node;
+    while (n->state.load() == NODE_EXPANDED) {
+        const Node* next = nullptr;
+        for (size_t i = 0; i < n->n_children; i++) {
+            const Node& child = nodes[n->first_child + i];
+            if (child.visits > 0 && (next == nullptr || child.visits > next->visits)) next = &child;
+        }
+        if (next == nullptr) break;
+        pv.push_back(next->move);
+        n = next;
+    }
+    return pv;
+}
+
+std::vector<MctsLine> MctsSearch::lines(size_t n) const {
+
+    std::vector<MctsLine> found;
+    if (capacity == 0 || nodes[0].state.load() != NODE_EXPANDED) return found;
+
+    const Node& root = nodes[0];
+    std::vector<const Node*> children;
+    for (size_t i = 0; i < root.n_children; i++) {
+        children.push_back(&nodes[root.first_child + i]);
+    }
+    std::stable_sort(children.begin(), children.end(), [](const Node* x, const Node* y) {
+        return x->visits > y->visits;
+    });
+
+    for (size_t i = 0; i < std::min(n, children.size()); i++) {
+        const Node& child = *children[i];
+        MctsLine l;
+        l.move = child.move;
+        l.visits = child.visits;
+        l.score = (l.visits > 0 ? value_to_cp((double)child.value / MCTS_VALUE_ONE / l.visits) : 0);
+        l.pv = line(child);
+        found.push_back(l);
+    }
+    return found;
+}
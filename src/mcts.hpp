@@ -0,0 +1,91 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+class Tablebases;
+
+// Monte Carlo tree search, the alternative to alpha-beta that Engine::backend
+// selects. Every simulation descends the tree by PUCT, with priors from see(),
+// expands the leaf it reaches and backs up the leaf's value, from either
+// evaluate() or a random playout. Several threads grow one tree, and a node
+// on a simulation still in progress counts MCTS_VIRTUAL_LOSS lost visits so
+// that the others spread over different lines. Nodes come from an arena
+// sized by resize(), and a search ends once the arena is full.
+
+enum MctsLeaf {
+    MCTS_EVAL,      // the static evaluation of the leaf
+    MCTS_PLAYOUT    // up to MCTS_PLAYOUT_PLIES random moves, then evaluated
+};
+
+// "eval" or "playout", as the binaries' --mcts-leaf options take them
+bool str_to_mcts_leaf(const std::string& name, MctsLeaf& leaf);
+
+// One root move, with its score in centipawns from the root player's point
+// of view and the most visited line starting with it
+struct MctsLine {
+    U16 move = 0;
+    int visits = 0;
+    int score = 0;
+    std::vector<U16> pv;
+};
+
+class MctsSearch {
+
+    public:
+    // threads growing the tree, the calling one included
+    int threads = 1;
+    MctsLeaf leaf = MCTS_EVAL;
+    // weight of the prior against the visits in PUCT
+    double exploration = 1.5;
+
+    // Sizes the arena like TranspositionTable::resize, up to the 2^32 - 1
+    // nodes first_child can index
+    void resize(size_t mb);
+
+    // Grows a new tree from b, with only moves at its root, until
+    // keep_searching returns false or the arena is full. keep_searching is
+    // called by one of the threads after each of its simulations, with the
+    // number finished by all of them. Positions found in occurences with a
+    // count of 2 are repetitions, and those the tablebases cover are scored
+    // from them. Returns the number of simulations.
+    long long search(const Board& b, const std::vector<U16>& moves, bool use_nnue,
+                     const std::unordered_map<std::string, int>& occurences, const Tablebases* tablebases,
+                     const std::function<bool(long long)>& keep_searching);
+
+    // the n most visited root moves of the last search, most visited first
+    std::vector<MctsLine> lines(size_t n) const;
+
+    private:
+    struct Node {
+        U16 move = 0;
+        U16 n_children = 0;
+        uint32_t first_child = 0;
+        float prior = 0;
+        std::atomic<uint8_t> state{0};
+        std::atomic<int32_t> visits{0};
+        // sum of the results for the player who made move, in 1/MCTS_VALUE_ONE
+        std::atomic<int64_t> value{0};
+    };
+
+    std::unique_ptr<Node[]> nodes;
+    size_t capacity = 0;
+    std::atomic<size_t> used{0};
+    std::atomic<bool> full{false};
+
+    bool expand(Node& node, const Board& b, const std::vector<U16>& moves);
+    Node* select(Node& parent) const;
+    double score_leaf(const Board& b, bool use_nnue, std::mt19937_64& rng) const;
+    std::vector<U16> line(const Node& node) const;
+};
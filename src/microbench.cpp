@@ -0,0 +1,200 @@
+#include <popl.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "board.hpp"
+#include "engine.hpp"
+
+// Micro-benchmarks of the Board primitives, the static evaluation and a fixed
+// depth search over bench_positions(). Each benchmark reports the time and
+// heap allocations per operation, and the search also its nodes per second.
+//
+// --json prints one JSON object per benchmark instead of the table; passing
+// such a file back as --baseline compares against it and fails if any
+// benchmark got slower by more than --max-regression percent.
+
+std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op = 0;
+    double allocs_per_op = 0;
+    double nodes_per_s = 0;
+};
+
+// Runs op, which performs ops_per_call operations, in doubling batches until
+// a batch takes at least min_seconds, and reports the last batch
+BenchResult run_bench(const std::string& name, int ops_per_call, double min_seconds, const std::function<void()>& op) {
+
+    BenchResult result;
+    result.name = name;
+
+    for (long long calls = 1; ; calls *= 2) {
+        size_t start_allocations = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < calls; i++) {
+            op();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t n_allocations = allocations.load() - start_allocations;
+
+        if (seconds >= min_seconds) {
+            double ops = (double)calls * ops_per_call;
+            result.ns_per_op = seconds * 1e9 / ops;
+            result.allocs_per_op = n_allocations / ops;
+            return result;
+        }
+    }
+}
+
+std::string to_json(const BenchResult& r) {
+    char line[256];
+    snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"nodes_per_s\":%.0f}",
+             r.name.c_str(), r.ns_per_op, r.allocs_per_op, r.nodes_per_s);
+    return line;
+}
+
+// ns_per_op of every benchmark in a --json output
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    char name[128];
+    double ns_per_op;
+    while (std::getline(in, line)) {
+        if (sscanf(line.c_str(), "{\"name\":\"%127[^\"]\",\"ns_per_op\":%lf", name, &ns_per_op) == 2) {
+            baseline[name] = ns_per_op;
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball micro-benchmarks");
+    std::string baseline_path, filter;
+    int depth;
+    double min_time, max_regression;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    auto json_op = op.add<popl::Switch>("j", "json", "print JSON lines instead of a table");
+    op.add<popl::Value<std::string>>("f", "filter", "only run benchmarks whose name contains this", "", &filter);
+    op.add<popl::Value<int>>("d", "depth", "depth of the search benchmark, in plies", 3, &depth);
+    op.add<popl::Value<double>>("", "min-time", "seconds each benchmark runs for at least", 0.2, &min_time);
+    op.add<popl::Value<std::string>>("b", "baseline", "compare against the --json output of another build", "", &baseline_path);
+    op.add<popl::Value<double>>("", "max-regression", "slowdown against the baseline that fails the run, in percent", 10, &max_regression);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+
+    std::vector<BenchResult> results;
+    volatile size_t sink = 0;
+
+    for (auto& position : bench_positions()) {
+        Board b = play_moves(position.moves);
+        auto moves = b.get_legal_moves();
+        std::vector<U16> legal_moves(moves.begin(), moves.end());
+        std::string suffix = std::string("/") + position.name;
+
+        auto add = [&](const std::string& name, int ops_per_call, const std::function<void()>& f) {
+            if (!filter.empty() && (name + suffix).find(filter) == std::string::npos) return;
+            results.push_back(run_bench(name + suffix, ops_per_call, min_time, f));
+        };
+
+        add("get_legal_moves", 1, [&]() {
+            sink += b.get_legal_moves().size();
+        });
+        add("in_check", 1, [&]() {
+            sink += b.in_check();
+        });
+        add("copy", 1, [&]() {
+            Board *c = b.copy();
+            sink += c->data.player_to_play;
+            delete c;
+        });
+        // Board only exposes do_move, so this copies the board for each move
+        add("do_move", legal_moves.size(), [&]() {
+            for (U16 m : legal_moves) {
+                Board c = b;
+                c.do_move(m);
+                sink += c.data.player_to_play;
+            }
+        });
+        add("evaluate", 1, [&]() {
+            sink += evaluate(b);
+        });
+        // quiet moves too, for whether the piece is safe on its new square
+        add("see", legal_moves.size(), [&]() {
+            for (U16 m : legal_moves) {
+                sink += see(b, m);
+            }
+        });
+
+        if (filter.empty() || ("search" + suffix).find(filter) != std::string::npos) {
+            Engine e;
+            e.verbose = false;
+            e.limits.depth = depth;
+            int nodes = 0;
+            BenchResult r = run_bench("search" + suffix, 1, min_time, [&]() {
+                e.search = true;
+                e.previous_board_occurences.clear();
+                e.tt.clear();
+                e.find_best_move(b);
+                nodes = e.nodes_visited;
+            });
+            // every search of a position visits the same nodes
+            r.nodes_per_s = nodes / (r.ns_per_op * 1e-9);
+            results.push_back(r);
+        }
+    }
+
+    auto baseline = (baseline_path.empty() ? std::map<std::string, double>() : read_baseline(baseline_path));
+    bool regressed = false;
+
+    if (!json_op->is_set()) {
+        printf("%-28s %14s %12s %14s%s\n", "benchmark", "ns/op", "allocs/op", "nodes/s", baseline.empty() ? "" : "   vs baseline");
+    }
+    for (auto& r : results) {
+        if (json_op->is_set()) {
+            std::cout << to_json(r) << std::endl;
+        } else {
+            printf("%-28s %14.1f %12.2f %14.0f", r.name.c_str(), r.ns_per_op, r.allocs_per_op, r.nodes_per_s);
+        }
+
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            double change = (r.ns_per_op / it->second - 1) * 100;
+            if (change > max_regression) regressed = true;
+            if (!json_op->is_set()) printf("   %+7.1f%%%s", change, change > max_regression ? "  REGRESSION" : "");
+        }
+        if (!json_op->is_set()) printf("\n");
+    }
+
+    return regressed ? 1 : 0;
+}
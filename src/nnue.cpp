@@ -0,0 +1,169 @@
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "nnue.hpp"
+
+std::unique_ptr<NnueNetwork> network;
+// shared by the searches using network, and taken by nnue_load to swap it
+std::shared_mutex network_mutex;
+
+// 0-3 for pawn, rook, king, bishop of the perspective's own color, 4-7 for
+// the opponent's
+int feature_index(U8 piece, U8 square, int perspective) {
+    int type = __builtin_ctz(piece & (PAWN | ROOK | KING | BISHOP)) - 1;
+    bool white = piece & WHITE;
+    if (perspective == 1) {
+        white = !white;
+        square = pos(6 - getx(square), 6 - gety(square));
+    }
+    return ((white ? 0 : 4) + type) * 56 + square;
+}
+
+bool nnue_load(const std::string& path) {
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    char magic[4];
+    uint32_t version, hidden;
+    in.read(magic, 4);
+    in.read((char*)&version, sizeof(version));
+    in.read((char*)&hidden, sizeof(hidden));
+    if (!in || memcmp(magic, "RBNN", 4) != 0 || version != NNUE_VERSION || hidden != NNUE_HIDDEN) {
+        return false;
+    }
+
+    auto net = std::make_unique<NnueNetwork>();
+    in.read((char*)net->feature_weights, sizeof(net->feature_weights));
+    in.read((char*)net->feature_biases, sizeof(net->feature_biases));
+    in.read((char*)net->output_weights, sizeof(net->output_weights));
+    in.read((char*)&net->output_bias, sizeof(net->output_bias));
+    in.read((char*)&net->output_divisor, sizeof(net->output_divisor));
+    if (!in || net->output_divisor == 0) return false;
+
+    // the old network is freed once swapped out, so never under a search
+    std::unique_lock<std::shared_mutex> lock(network_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) return false;
+    network.swap(net);
+    return true;
+}
+
+std::shared_lock<std::shared_mutex> nnue_use() {
+    return std::shared_lock<std::shared_mutex>(network_mutex);
+}
+
+bool nnue_loaded() {
+    return network != nullptr;
+}
+
+U64 nnue_fingerprint() {
+    if (!network) return 0;
+    // FNV-1a; the padding of the aligned members is zeroed by make_unique
+    const unsigned char *bytes = (const unsigned char*)network.get();
+    U64 h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(NnueNetwork); i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void add_feature(int16_t *acc, int feature) {
+    const int16_t *w = network->feature_weights[feature];
+    for (int i=0; i<NNUE_HIDDEN; i++) acc[i] += w[i];
+}
+
+void sub_feature(int16_t *acc, int feature) {
+    const int16_t *w = network->feature_weights[feature];
+    for (int i=0; i<NNUE_HIDDEN; i++) acc[i] -= w[i];
+}
+
+void nnue_refresh(const Board& b, NnueAccumulator& acc) {
+
+    const U8 *pieces = (const U8*)(&(b.data));
+
+    for (int p=0; p<2; p++) {
+        memcpy(acc.values[p], network->feature_biases, sizeof(acc.values[p]));
+        for (int i=0; i<12; i++) {
+            if (pieces[i] == DEAD) continue;
+            add_feature(acc.values[p], feature_index(b.data.board_0[pieces[i]], pieces[i], p));
+        }
+    }
+}
+
+void nnue_update(const NnueAccumulator& parent, const Board& b, U16 move, NnueAccumulator& child) {
+
+    U8 p0 = getp0(move);
+    U8 p1 = getp1(move);
+    U8 piece = b.data.board_0[p0];
+    U8 captured = b.data.board_0[p1];
+
+    U8 new_piece = piece;
+    if      (getpromo(move) == PAWN_ROOK)   new_piece = (piece & (WHITE | BLACK)) | ROOK;
+    else if (getpromo(move) == PAWN_BISHOP) new_piece = (piece & (WHITE | BLACK)) | BISHOP;
+
+    memcpy(&child, &parent, sizeof(NnueAccumulator));
+    for (int p=0; p<2; p++) {
+        sub_feature(child.values[p], feature_index(piece, p0, p));
+        add_feature(child.values[p], feature_index(new_piece, p1, p));
+        if (captured) {
+            sub_feature(child.values[p], feature_index(captured, p1, p));
+        }
+    }
+}
+
+#ifdef __AVX2__
+
+// output_weights . crelu(acc) over one perspective, 32 neurons at a time
+int32_t output_dot(const int16_t *acc, const int8_t *weights) {
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int i=0; i<NNUE_HIDDEN; i+=32) {
+        __m256i a0 = _mm256_load_si256((const __m256i*)(acc + i));
+        __m256i a1 = _mm256_load_si256((const __m256i*)(acc + i + 16));
+        // saturate to int8, clip at 0 and undo the lane interleaving of packs
+        __m256i act = _mm256_max_epi8(_mm256_packs_epi16(a0, a1), zero);
+        act = _mm256_permute4x64_epi64(act, 0xd8);
+        __m256i w = _mm256_loadu_si256((const __m256i*)(weights + i));
+        __m256i prod = _mm256_madd_epi16(_mm256_maddubs_epi16(act, w), ones);
+        sum = _mm256_add_epi32(sum, prod);
+    }
+
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+#else
+
+int32_t output_dot(const int16_t *acc, const int8_t *weights) {
+
+    int32_t sum = 0;
+    for (int i=0; i<NNUE_HIDDEN; i++) {
+        int16_t a = acc[i];
+        int32_t act = a < 0 ? 0 : a > 127 ? 127 : a;
+        sum += act * weights[i];
+    }
+    return sum;
+}
+
+#endif
+
+int nnue_evaluate(const NnueAccumulator& acc, PlayerColor side) {
+
+    int us = (side == WHITE ? 0 : 1);
+    int32_t out = network->output_bias;
+    out += output_dot(acc.values[us], network->output_weights);
+    out += output_dot(acc.values[1 - us], network->output_weights + NNUE_HIDDEN);
+
+    return out / network->output_divisor;
+}
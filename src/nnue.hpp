@@ -0,0 +1,65 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Small NNUE style evaluator. The inputs are (color, piece type, square)
+// features over the 56 squares below DEAD, seen from both sides: white's
+// perspective uses the board as is, black's rotates it by 180 degrees and
+// swaps the colors. Each perspective has its own accumulator, updated
+// incrementally from the parent position as moves are made.
+//
+// The network is
+//     acc[p] = feature_biases + sum of feature_weights[f] over active f
+//     out    = output_weights . [crelu(acc[us]), crelu(acc[them])] + output_bias
+//     score  = out / output_divisor
+// with int16 accumulators, int8 activations clipped to [0, 127] and int8
+// output weights.
+//
+// File layout (little endian): the magic "RBNN", uint32 version, uint32
+// hidden size, then feature_weights, feature_biases, output_weights,
+// output_bias and output_divisor in the order and types of NnueNetwork.
+
+const int NNUE_INPUTS = 8 * 56;
+const int NNUE_HIDDEN = 128;
+const uint32_t NNUE_VERSION = 1;
+
+struct NnueNetwork {
+    alignas(32) int16_t feature_weights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(32) int16_t feature_biases[NNUE_HIDDEN];
+    alignas(32) int8_t output_weights[2 * NNUE_HIDDEN];
+    int32_t output_bias;
+    int32_t output_divisor;
+};
+
+struct NnueAccumulator {
+    // indexed by perspective, 0 for white and 1 for black
+    alignas(32) int16_t values[2][NNUE_HIDDEN];
+};
+
+// Loads the process wide network; returns false if the file is unreadable or
+// does not match this build's dimensions, or if a search is using the current
+// network
+bool nnue_load(const std::string& path);
+// Held by a search for as long as it may evaluate with the network, which
+// nnue_load does not replace meanwhile
+std::shared_lock<std::shared_mutex> nnue_use();
+bool nnue_loaded();
+// Hash of the loaded network's parameters, 0 if there is none
+U64 nnue_fingerprint();
+
+// Computes the accumulator of b from scratch
+void nnue_refresh(const Board& b, NnueAccumulator& acc);
+
+// Computes the accumulator after move from the one of b, the position
+// before the move
+void nnue_update(const NnueAccumulator& parent, const Board& b, U16 move, NnueAccumulator& child);
+
+// Network output for the side to play
+int nnue_evaluate(const NnueAccumulator& acc, PlayerColor side);
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "records.hpp"
+
+const char RECORD_MAGIC[4] = {'R', 'B', 'R', 'C'};
+const size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+// piece in each BoardData slot before any promotion
+const U8 slot_pieces[12] = {
+    BLACK | ROOK, BLACK | ROOK, BLACK | KING, BLACK | BISHOP, BLACK | PAWN, BLACK | PAWN,
+    WHITE | ROOK, WHITE | ROOK, WHITE | KING, WHITE | BISHOP, WHITE | PAWN, WHITE | PAWN
+};
+
+// the pawn slots, in the order their promotions are packed
+const int pawn_slots[4] = {4, 5, 10, 11};
+
+PositionRecord make_position_record(const Board& b, int score, RecordResult result) {
+
+    PositionRecord record;
+    const U8 *positions = (const U8*)(&(b.data));
+
+    memcpy(record.positions, positions, 12);
+    record.flags = (b.data.player_to_play == BLACK ? 1 : 0) | (result << 1);
+    record.promotions = 0;
+    for (int i=0; i<4; i++) {
+        U8 p = positions[pawn_slots[i]];
+        if (p == DEAD) continue;
+        if      (b.data.board_0[p] & ROOK)   record.promotions |= 1 << (2*i);
+        else if (b.data.board_0[p] & BISHOP) record.promotions |= 2 << (2*i);
+    }
+    record.score = (int16_t)std::max(-32000, std::min(32000, score));
+
+    return record;
+}
+
+PlayerColor record_player(const PositionRecord& record) {
+    return (record.flags & 1) ? BLACK : WHITE;
+}
+
+RecordResult record_result(const PositionRecord& record) {
+    return (RecordResult)((record.flags >> 1) & 3);
+}
+
+void set_record_result(PositionRecord& record, RecordResult result) {
+    record.flags = (record.flags & 1) | (result << 1);
+}
+
+Board record_to_board(const PositionRecord& record) {
+
+    U8 pieces[12];
+    memcpy(pieces, slot_pieces, 12);
+    for (int i=0; i<4; i++) {
+        int promo = (record.promotions >> (2*i)) & 3;
+        U8 color = pieces[pawn_slots[i]] & (WHITE | BLACK);
+        if      (promo == 1) pieces[pawn_slots[i]] = color | ROOK;
+        else if (promo == 2) pieces[pawn_slots[i]] = color | BISHOP;
+    }
+
+    return board_from_pieces(record.positions, pieces, record_player(record));
+}
+
+RecordWriter::~RecordWriter() {
+    close();
+}
+
+bool RecordWriter::open(const std::string& path, RecordKind kind) {
+
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    ok = true;
+
+    buffer.resize(WRITE_BUFFER_SIZE);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    RecordFileHeader header = {};
+    memcpy(header.magic, RECORD_MAGIC, 4);
+    header.version = RECORD_FORMAT_VERSION;
+    header.kind = kind;
+    return write_raw(&header, sizeof(header));
+}
+
+bool RecordWriter::close() {
+    if (file != nullptr) {
+        // the buffer is only flushed here, which can fail too
+        ok = (fclose(file) == 0) && ok;
+        file = nullptr;
+    }
+    return ok;
+}
+
+bool RecordWriter::write_raw(const void *data, size_t size) {
+    ok = ok && file != nullptr && fwrite(data, 1, size, file) == size;
+    return ok;
+}
+
+bool RecordWriter::write(const PositionRecord& record) {
+    return write_raw(&record, sizeof(record));
+}
+
+bool RecordWriter::write_game(const std::vector<U16>& moves, RecordResult result, int opening_plies) {
+
+    // a header that does not fit its game would misplace every later one
+    if (moves.size() > UINT16_MAX || opening_plies < 0 || opening_plies > UINT8_MAX) return false;
+
+    GameRecordHeader header;
+    header.n_moves = (uint16_t)moves.size();
+    header.result = result;
+    header.opening_plies = (uint8_t)opening_plies;
+
+    return write_raw(&header, sizeof(header)) && write_raw(moves.data(), moves.size() * sizeof(U16));
+}
+
+RecordReader::~RecordReader() {
+    close();
+}
+
+bool RecordReader::open(const std::string& path, RecordKind kind) {
+
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RecordFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    data = (const char*)mapping;
+    length = st.st_size;
+    cursor = sizeof(RecordFileHeader);
+
+    const RecordFileHeader *header = (const RecordFileHeader*)data;
+    if (memcmp(header->magic, RECORD_MAGIC, 4) != 0
+        || header->version != RECORD_FORMAT_VERSION
+        || header->kind != kind) {
+        close();
+        return false;
+    }
+
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+void RecordReader::close() {
+    if (data != nullptr) {
+        munmap((void*)data, length);
+        data = nullptr;
+        length = 0;
+    }
+}
+
+size_t RecordReader::size() const {
+    if (data == nullptr) return 0;
+    return (length - sizeof(RecordFileHeader)) / sizeof(PositionRecord);
+}
+
+const PositionRecord& RecordReader::operator[](size_t i) const {
+    return begin()[i];
+}
+
+const PositionRecord* RecordReader::begin() const {
+    return (const PositionRecord*)(data + sizeof(RecordFileHeader));
+}
+
+const PositionRecord* RecordReader::end() const {
+    return begin() + size();
+}
+
+bool RecordReader::next_game(GameView& game) {
+
+    if (data == nullptr || cursor + sizeof(GameRecordHeader) > length) return false;
+
+    GameRecordHeader header;
+    memcpy(&header, data + cursor, sizeof(header));
+    size_t moves_size = header.n_moves * sizeof(U16);
+    if (cursor + sizeof(header) + moves_size > length) return false;
+
+    game.result = (RecordResult)header.result;
+    game.opening_plies = header.opening_plies;
+    game.n_moves = header.n_moves;
+    game.moves = (const U16*)(data + cursor + sizeof(header));
+
+    cursor += sizeof(header) + moves_size;
+    return true;
+}
+
+void RecordReader::rewind() {
+    cursor = sizeof(RecordFileHeader);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "board.hpp"
+
+// Binary formats for self-play output. A file is a RecordFileHeader followed
+// by either fixed size PositionRecords or variable length games. The structs
+// are written as they are in memory, so fields are in host byte order, which
+// is little endian on every target (checked below).
+//
+// Position files can be memory mapped and indexed directly. A game is a
+// GameRecordHeader followed by n_moves U16 moves played from Board().
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "record files are little endian");
+
+enum RecordKind : uint16_t {
+    POSITION_RECORDS = 1,
+    GAME_RECORDS     = 2
+};
+
+const uint16_t RECORD_FORMAT_VERSION = 1;
+
+struct RecordFileHeader {
+    char magic[4];      // "RBRC"
+    uint16_t version;
+    uint16_t kind;
+    uint64_t reserved;
+};
+
+// The game result, from white's point of view
+enum RecordResult : uint8_t {
+    RESULT_DRAW      = 0,
+    RESULT_WHITE_WIN = 1,
+    RESULT_BLACK_WIN = 2,
+    RESULT_UNKNOWN   = 3
+};
+
+struct PositionRecord {
+    U8 positions[12];   // piece squares in BoardData order, DEAD if captured
+    U8 flags;           // bit 0: black to play, bits 1-2: RecordResult
+    U8 promotions;      // 2 bits per pawn slot: 0 pawn, 1 rook, 2 bishop
+    int16_t score;      // search score for the side to play, clamped
+};
+
+static_assert(sizeof(PositionRecord) == 16, "PositionRecord must stay 16 bytes");
+
+struct GameRecordHeader {
+    uint16_t n_moves;
+    uint8_t result;         // RecordResult
+    uint8_t opening_plies;  // leading moves that were randomized
+};
+
+// A game in a mapped file; moves points into the mapping
+struct GameView {
+    RecordResult result;
+    int opening_plies;
+    int n_moves;
+    const U16 *moves;
+};
+
+PositionRecord make_position_record(const Board& b, int score, RecordResult result);
+Board record_to_board(const PositionRecord& record);
+PlayerColor record_player(const PositionRecord& record);
+RecordResult record_result(const PositionRecord& record);
+void set_record_result(PositionRecord& record, RecordResult result);
+
+// Buffered, append only writer. Not thread safe. Writes return false once
+// any of them failed, or if the writer is not open, and so does close() if
+// the file is then incomplete. write_game also refuses, without writing,
+// games of more than 65535 moves or 255 opening plies.
+class RecordWriter {
+
+    public:
+    ~RecordWriter();
+
+    bool open(const std::string& path, RecordKind kind);
+    bool close();
+
+    bool write(const PositionRecord& record);
+    bool write_game(const std::vector<U16>& moves, RecordResult result, int opening_plies);
+    bool write_raw(const void *data, size_t size);
+
+    private:
+    FILE *file = nullptr;
+    std::vector<char> buffer;
+    bool ok = true;
+};
+
+// Read only memory mapping of a record file
+class RecordReader {
+
+    public:
+    ~RecordReader();
+
+    bool open(const std::string& path, RecordKind kind);
+    void close();
+
+    // positions files
+    size_t size() const;
+    const PositionRecord& operator[](size_t i) const;
+    const PositionRecord* begin() const;
+    const PositionRecord* end() const;
+
+    // games files: reads the game at the cursor and advances past it
+    bool next_game(GameView& game);
+    void rewind();
+
+    private:
+    const char *data = nullptr;
+    size_t length = 0;
+    size_t cursor = sizeof(RecordFileHeader);
+};
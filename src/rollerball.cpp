@@ -1,17 +1,102 @@
 #include <popl.hpp>
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include "uciws.hpp"
 #include "board.hpp"
+#include "book.hpp"
 #include "engine.hpp"
+#include "nnue.hpp"
+#include "tablebase.hpp"
+#include "workers.hpp"
+
+#ifdef ENGINE_PY
+#include "engine_py.hpp"
+#else
+#include "bench.hpp"
+#endif
 
 #define BOT_NAME "cs1200869"
 
+#ifndef ENGINE_PY
+
+// rollerball bench: searches bench_positions() one after the other on this
+// thread, with a fresh engine each. The total node count is a signature of
+// the search, which stays the same as long as its behaviour does.
+int bench(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball bench");
+    SearchLimits limits;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    op.add<popl::Value<int>>("d", "depth", "search depth, in plies", 3, &limits.depth);
+    op.add<popl::Value<int>>("n", "nodes", "node limit per position, instead of the depth", 0, &limits.nodes);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    if (limits.nodes > 0) {
+        limits.depth = 0;
+    }
+
+    long long total_nodes = 0, total_us = 0;
+    for (auto& position : bench_positions()) {
+        Engine e;
+        e.verbose = false;
+        e.limits = limits;
+        e.search = true;
+        e.find_best_move(play_moves(position.moves));
+
+        total_nodes += e.nodes_visited;
+        total_us += e.search_time_us;
+        std::cout << std::left << std::setw(12) << position.name
+                  << " nodes " << std::setw(10) << e.nodes_visited
+                  << " bestmove " << move_to_str(e.best_move) << std::endl;
+    }
+
+    std::cout << "nodes " << total_nodes << std::endl;
+    std::cout << "nps " << (total_us > 0 ? total_nodes * 1000000 / total_us : 0) << std::endl;
+    return 0;
+}
+
+#endif
+
 int main(int argc, char** argv) {
 
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+#ifdef ENGINE_PY
+        // the node counts are a signature of the C++ search only
+        std::cout << "ERROR: bench is only in bin/rollerball" << std::endl;
+        return 0;
+#else
+        return bench(argc - 1, argv + 1);
+#endif
+    }
+
     popl::OptionParser op("Rollerball");
     int port;
+    int threads, hash_mb, mate_hash_mb, mate_check, mcts_threads;
+    std::string nnue_path, book_path, tb_dir, stats_path, hash_path, shared_hash, worker_uris, search, mcts_leaf;
     auto port_op = op.add<popl::Value<int>>("p", "port", "port number", -1, &port);
+    auto threads_op = op.add<popl::Value<int>>("t", "threads", "search threads shared by all games", std::thread::hardware_concurrency(), &threads);
+    op.add<popl::Value<int>>("", "hash", "transposition table size of each game, in MB, not counting its --mate-hash table", 16, &hash_mb);
+    op.add<popl::Value<std::string>>("", "hash-file", "start games with the transposition table saved in this file, and save theirs to it when they end", "", &hash_path);
+    op.add<popl::Value<std::string>>("", "shared-hash", "share one transposition table between all games, and other servers given the same name, in this POSIX shared memory object (e.g. /rollerball); it is created with --hash MB", "", &shared_hash);
+    op.add<popl::Value<std::string>>("", "search", "search backend, alphabeta or mcts", "alphabeta", &search);
+    op.add<popl::Value<std::string>>("", "mcts-leaf", "how MCTS scores the leaves it expands, eval or playout", "eval", &mcts_leaf);
+    op.add<popl::Value<int>>("", "mcts-threads", "threads each MCTS search grows its tree on", 1, &mcts_threads);
+    op.add<popl::Value<int>>("", "mate-check", "before each search, look for a mate in up to this many moves", 0, &mate_check);
+    op.add<popl::Value<int>>("", "mate-hash", "mate solver table size of each game that uses --mate-check or go mate, in MB", 4, &mate_hash_mb);
+    op.add<popl::Value<std::string>>("", "nnue", "evaluate with the network in this file", "", &nnue_path);
+    op.add<popl::Value<std::string>>("", "book", "opening book file", "", &book_path);
+    op.add<popl::Value<std::string>>("", "tb", "directory of endgame tablebases", "", &tb_dir);
+    op.add<popl::Value<std::string>>("", "stats", "append the statistics of every search to this file, as JSON lines", "", &stats_path);
+    auto worker_op = op.add<popl::Switch>("", "worker", "only search root moves handed out by a coordinator's --workers");
+    op.add<popl::Value<std::string>>("", "workers", "split the root moves of every search between the --worker servers at these comma separated URIs (e.g. ws://localhost:8182,ws://localhost:8183); a URI given n times gets n searches at once", "", &worker_uris);
     op.parse(argc, argv);
 
     if (port == -1) {
@@ -19,7 +104,85 @@ int main(int argc, char** argv) {
         return 0;
     }
 
-    UCIWSServer server(BOT_NAME, port);
+    SearchBackend backend;
+    MctsLeaf leaf;
+    if (!str_to_backend(search, backend)) {
+        std::cout << "ERROR: unknown search " << search << std::endl;
+        return 0;
+    }
+#ifdef ENGINE_PY
+    if (backend != SEARCH_ALPHA_BETA) {
+        std::cout << "ERROR: engine.py does its own search, --search does not apply" << std::endl;
+        return 0;
+    }
+#endif
+    if (!str_to_mcts_leaf(mcts_leaf, leaf)) {
+        std::cout << "ERROR: unknown MCTS leaf evaluation " << mcts_leaf << std::endl;
+        return 0;
+    }
+
+    if (!nnue_path.empty() && !nnue_load(nnue_path)) {
+        std::cout << "ERROR: could not load network " << nnue_path << std::endl;
+        return 0;
+    }
+
+    OpeningBook book;
+    if (!book_path.empty() && !book.open(book_path)) {
+        std::cout << "ERROR: could not open book " << book_path << std::endl;
+        return 0;
+    }
+
+    Tablebases tablebases;
+    if (!tb_dir.empty() && !tablebases.open(tb_dir)) {
+        std::cout << "ERROR: no tablebases found in " << tb_dir << std::endl;
+        return 0;
+    }
+
+    WorkerPool workers;
+    if (!worker_uris.empty()) {
+        std::vector<std::string> uris;
+        std::istringstream in(worker_uris);
+        for (std::string uri; std::getline(in, uri, ',');) {
+            if (!uri.empty()) uris.push_back(uri);
+        }
+        if (!workers.connect(uris)) {
+            std::cout << "ERROR: invalid worker URI in " << worker_uris << std::endl;
+            return 0;
+        }
+    }
+
+    UCIWSServer server(BOT_NAME, port, threads);
+    server.use_nnue = nnue_loaded();
+    server.hash_mb = std::max(hash_mb, 1);
+    server.mate_check = std::max(mate_check, 0);
+    server.mate_hash_mb = std::max(mate_hash_mb, 1);
+    server.backend = backend;
+    server.mcts_leaf = leaf;
+    server.mcts_threads = std::max(mcts_threads, 1);
+    server.hash_file = hash_path;
+    server.shared_hash = shared_hash;
+    if (book.is_open()) {
+        server.book = &book;
+    }
+    if (tablebases.max_pieces() > 0) {
+        server.tablebases = &tablebases;
+    }
+    if (!worker_uris.empty()) {
+        server.workers = &workers;
+    }
+    server.worker = worker_op->is_set();
+    if (!stats_path.empty()) {
+        server.stats_log.open(stats_path, std::ios::app);
+        if (!server.stats_log) {
+            std::cout << "ERROR: could not open " << stats_path << std::endl;
+            return 0;
+        }
+    }
+
+#ifdef ENGINE_PY
+    // when the server starts rather than on the first move
+    start_python_engine();
+#endif
 
     server.start();
 
@@ -0,0 +1,72 @@
+#include <unordered_map>
+
+#include "selfplay.hpp"
+
+Board random_opening(int plies, std::mt19937& rng, std::vector<U16>* moves) {
+    while (true) {
+        Board b;
+        if (moves) moves->clear();
+        int i = 0;
+        for (; i < plies; i++) {
+            auto legal_moves = b.get_sorted_legal_moves();
+            if (legal_moves.empty()) break;
+            U16 m = legal_moves[rng() % legal_moves.size()];
+            b.do_move(m);
+            if (moves) moves->push_back(m);
+        }
+        if (i == plies && !b.get_legal_moves().empty()) return b;
+    }
+}
+
+GameOutcome play_game(Board b, const SearchLimits& white, const SearchLimits& black, int max_moves, const MoveCallback& on_move,
+                      const EngineSetup& setup) {
+
+    Engine white_engine, black_engine;
+    white_engine.verbose = black_engine.verbose = false;
+    white_engine.limits = white;
+    black_engine.limits = black;
+    if (setup) {
+        setup(white_engine, WHITE);
+        setup(black_engine, BLACK);
+    }
+
+    std::unordered_map<U64, int> occurences;
+    occurences[b.hash()]++;
+
+    GameOutcome outcome;
+    while (true) {
+        auto moves = b.get_sorted_legal_moves();
+        if (moves.empty()) {
+            if (b.in_check()) {
+                outcome.result = (b.data.player_to_play == WHITE ? -1 : 1);
+                outcome.reason = "checkmate";
+            }
+            else {
+                outcome.reason = "stalemate";
+            }
+            return outcome;
+        }
+        if ((int)outcome.moves.size() >= 2 * max_moves) {
+            outcome.reason = "move cap";
+            return outcome;
+        }
+
+        Engine& e = (b.data.player_to_play == WHITE ? white_engine : black_engine);
+        e.search = true;
+        e.find_best_move(b);
+        U16 move = e.best_move;
+        if (!std::binary_search(moves.begin(), moves.end(), move)) {
+            move = moves[0];
+        }
+        if (on_move) {
+            on_move(b, e, move);
+        }
+        b.do_move(move);
+        outcome.moves.push_back(move);
+
+        if (++occurences[b.hash()] == 3) {
+            outcome.reason = "threefold repetition";
+            return outcome;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+#include "engine.hpp"
+
+// Engine against engine games, shared by the match runner and the data
+// generator
+
+struct GameOutcome {
+    int result = 0; // +1 white won, 0 draw, -1 black won
+    std::string reason;
+    std::vector<U16> moves;
+};
+
+// Called before each engine move with the position, the engine that searched
+// it and the move it is about to play
+typedef std::function<void(const Board&, const Engine&, U16)> MoveCallback;
+
+// Called once for each engine before the game, with the colour it plays
+typedef std::function<void(Engine&, PlayerColor)> EngineSetup;
+
+// Plays uniformly random legal moves from the start position, retrying until
+// the opening does not end the game. The moves played are stored in moves if
+// it is given.
+Board random_opening(int plies, std::mt19937& rng, std::vector<U16>* moves = nullptr);
+
+// Plays from b until checkmate, stalemate, threefold repetition or max_moves
+// moves per side, with a fresh engine for each colour
+GameOutcome play_game(Board b, const SearchLimits& white, const SearchLimits& black, int max_moves, const MoveCallback& on_move = nullptr,
+                      const EngineSetup& setup = nullptr);
@@ -101,8 +101,8 @@ void WebsocketServer::onClose(ClientConnection conn)
 
 void WebsocketServer::onMessage(ClientConnection conn, WebsocketEndpoint::message_ptr msg)
 {
-    //Validate that the incoming message contains valid JSON
-    string message = msg->get_payload();
+    //Hand the payload to the handlers by reference, without copying it
+    const string& message = msg->get_payload();
 
     for (auto handler : this->messageHandlers) {
         handler(conn, message);
@@ -0,0 +1,48 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#pragma pop_macro("move")
+
+// Search statistics, compiled in with -DSEARCH_STATS. Without it STATS()
+// drops its statement and SearchStats has no counters, so a normal build
+// pays nothing for them.
+#ifdef SEARCH_STATS
+#define STATS(statement) statement
+#else
+#define STATS(statement)
+#endif
+
+struct SearchStats {
+#ifdef SEARCH_STATS
+    uint64_t qnodes             = 0;    // nodes of the quiescence re-searches
+    uint64_t tb_hits            = 0;
+    uint64_t tt_hits            = 0;
+    uint64_t tt_cutoffs         = 0;    // nodes answered by the table alone
+    uint64_t cutoffs            = 0;
+    uint64_t first_move_cutoffs = 0;    // cutoffs by the first move searched
+    uint64_t movegen_ns         = 0;
+    uint64_t eval_ns            = 0;
+    std::vector<uint64_t> iteration_nodes;
+#endif
+
+    void reset() {
+        *this = SearchStats();
+    }
+};
+
+#ifdef SEARCH_STATS
+// Adds the time until it goes out of scope to counter
+struct StatsTimer {
+    uint64_t& counter;
+    std::chrono::steady_clock::time_point start;
+
+    StatsTimer(uint64_t& counter): counter(counter), start(std::chrono::steady_clock::now()) {}
+    ~StatsTimer() {
+        counter += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+#endif
@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tablebase.hpp"
+
+const char TB_MAGIC[4] = {'R', 'B', 'T', 'B'};
+
+// per color, in index order
+const U8 TB_PIECE_TYPES[3] = {ROOK, BISHOP, PAWN};
+
+struct TBSquares {
+    U8 squares[TB_SQUARES];
+    int index[64];
+
+    constexpr TBSquares(): squares(), index() {
+        int n = 0;
+        for (int p = 0; p < 64; p++) {
+            int x = getx(p), y = gety(p);
+            bool on_board = x < 7 && y < 7 && !(x >= 2 && x <= 4 && y >= 2 && y <= 4);
+            index[p] = on_board ? n : -1;
+            if (on_board) squares[n++] = p;
+        }
+    }
+};
+
+constexpr TBSquares tb_squares;
+
+int material_count(Material m, int color_idx, int type_idx) {
+    return (m >> (3 * (3 * color_idx + type_idx))) & 7;
+}
+
+int material_pieces(Material m) {
+    int n = 2;
+    for (int i = 0; i < 6; i++) {
+        n += (m >> (3 * i)) & 7;
+    }
+    return n;
+}
+
+int material_pawns(Material m) {
+    return material_count(m, 0, 2) + material_count(m, 1, 2);
+}
+
+std::string material_name(Material m) {
+    const char names[3] = {'R', 'B', 'P'};
+    std::string name;
+    for (int c = 0; c < 2; c++) {
+        if (c == 1) name += 'v';
+        name += 'K';
+        for (int t = 0; t < 3; t++) {
+            name.append(material_count(m, c, t), names[t]);
+        }
+    }
+    return name;
+}
+
+size_t material_size(Material m) {
+    size_t size = 2;
+    for (int i = 0; i < material_pieces(m); i++) {
+        size *= TB_SQUARES;
+    }
+    return size;
+}
+
+Material mirror_material(Material m) {
+    return (m >> 9) | ((m & 0x1ff) << 9);
+}
+
+std::vector<Material> all_materials(int max_pieces) {
+
+    // rooks and bishops beyond the first two and first one only fit in the
+    // pawn slots, as promoted pawns
+    auto fits = [](int rooks, int bishops, int pawns) {
+        return std::max(rooks - 2, 0) + std::max(bishops - 1, 0) + pawns <= 2;
+    };
+
+    std::vector<Material> sides;
+    for (int r = 0; r <= 4; r++) {
+        for (int b = 0; b <= 3; b++) {
+            for (int p = 0; p <= 2; p++) {
+                if (fits(r, b, p)) sides.push_back(r | (b << 3) | (p << 6));
+            }
+        }
+    }
+
+    std::vector<Material> materials;
+    for (Material white : sides) {
+        for (Material black : sides) {
+            Material m = white | (black << 9);
+            if (m != 0 && m <= mirror_material(m) && material_pieces(m) <= max_pieces) materials.push_back(m);
+        }
+    }
+
+    // tables only depend on ones with fewer pieces, or fewer pawns after a
+    // promotion
+    std::sort(materials.begin(), materials.end(), [](Material a, Material b) {
+        if (material_pieces(a) != material_pieces(b)) return material_pieces(a) < material_pieces(b);
+        if (material_pawns(a) != material_pawns(b)) return material_pawns(a) < material_pawns(b);
+        return a < b;
+    });
+    return materials;
+}
+
+Material board_material(const Board& b) {
+
+    const U8 *positions = (const U8*)(&(b.data));
+    Material m = 0;
+
+    for (int i = 0; i < 12; i++) {
+        if (positions[i] == DEAD) continue;
+        U8 piece = b.data.board_0[positions[i]];
+        if (piece & KING) continue;
+        int c = (piece & WHITE) ? 0 : 1;
+        int t = (piece & ROOK) ? 0 : (piece & BISHOP) ? 1 : 2;
+        m += 1 << (3 * (3 * c + t));
+    }
+    return m;
+}
+
+// Pieces in index order, as color | type; returns their number
+int material_piece_list(Material m, U8 *pieces) {
+
+    int n = 0;
+    pieces[n++] = WHITE | KING;
+    pieces[n++] = BLACK | KING;
+    for (int c = 0; c < 2; c++) {
+        U8 color = (c == 0 ? WHITE : BLACK);
+        for (int t = 0; t < 3; t++) {
+            for (int k = 0; k < material_count(m, c, t); k++) {
+                pieces[n++] = color | TB_PIECE_TYPES[t];
+            }
+        }
+    }
+    return n;
+}
+
+size_t tb_board_to_index(const Board& b, Material m) {
+
+    U8 pieces[12];
+    int n = material_piece_list(m, pieces);
+
+    // squares of each piece kind, in index order
+    int squares[12];
+    bool used[12] = {};
+    const U8 *positions = (const U8*)(&(b.data));
+    for (int i = 0; i < 12; i++) {
+        if (positions[i] == DEAD) continue;
+        U8 piece = b.data.board_0[positions[i]];
+        for (int j = 0; j < n; j++) {
+            if (!used[j] && pieces[j] == piece) {
+                used[j] = true;
+                squares[j] = tb_squares.index[positions[i]];
+                break;
+            }
+        }
+    }
+    for (int j = 1; j < n; j++) {
+        for (int k = j; k > 0 && pieces[k - 1] == pieces[k] && squares[k - 1] > squares[k]; k--) {
+            std::swap(squares[k - 1], squares[k]);
+        }
+    }
+
+    size_t index = (b.data.player_to_play == WHITE ? 0 : 1);
+    for (int j = 0; j < n; j++) {
+        index = index * TB_SQUARES + squares[j];
+    }
+    return index;
+}
+
+bool tb_index_to_board(Material m, size_t index, Board& b) {
+
+    U8 pieces[12];
+    int n = material_piece_list(m, pieces);
+
+    int squares[12];
+    for (int j = n - 1; j >= 0; j--) {
+        squares[j] = index % TB_SQUARES;
+        index /= TB_SQUARES;
+    }
+    PlayerColor player = (index == 0 ? WHITE : BLACK);
+
+    for (int j = 0; j < n; j++) {
+        for (int k = 0; k < j; k++) {
+            if (squares[k] == squares[j]) return false;
+        }
+        if (j > 0 && pieces[j - 1] == pieces[j] && squares[j - 1] > squares[j]) return false;
+    }
+
+    // kings, then pawns, take their own slots; further rooks and bishops go
+    // to the free pawn slots, as if they had been promoted
+    U8 positions[12], slot_pieces[12];
+    std::fill(positions, positions + 12, DEAD);
+    std::fill(slot_pieces, slot_pieces + 12, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int j = 0; j < n; j++) {
+            bool pawn_or_king = pieces[j] & (PAWN | KING);
+            if ((pass == 0) != pawn_or_king) continue;
+
+            int base = (pieces[j] & WHITE) ? 6 : 0;
+            int candidates[4];
+            int n_candidates = 0;
+            if      (pieces[j] & KING)   { candidates[n_candidates++] = 2; }
+            else if (pieces[j] & ROOK)   { candidates[n_candidates++] = 0; candidates[n_candidates++] = 1; }
+            else if (pieces[j] & BISHOP) { candidates[n_candidates++] = 3; }
+            if (!(pieces[j] & KING)) {
+                candidates[n_candidates++] = 4;
+                candidates[n_candidates++] = 5;
+            }
+
+            for (int k = 0; k < n_candidates; k++) {
+                int slot = base + candidates[k];
+                if (positions[slot] == DEAD) {
+                    positions[slot] = tb_squares.squares[squares[j]];
+                    slot_pieces[slot] = pieces[j];
+                    break;
+                }
+            }
+        }
+    }
+
+    // the side that just moved cannot have left its king in check
+    PlayerColor opponent = (PlayerColor)(player ^ (WHITE | BLACK));
+    b = board_from_pieces(positions, slot_pieces, opponent);
+    if (b.in_check()) return false;
+    b.data.player_to_play = player;
+
+    return true;
+}
+
+TBResult tb_decode(U8 value) {
+    TBResult r;
+    if (value == TB_DRAW) return r;
+    r.plies = value - 1;
+    r.result = (r.plies % 2 == 1 ? 1 : -1);
+    return r;
+}
+
+Tablebases::~Tablebases() {
+    close();
+}
+
+bool Tablebases::open(const std::string& dir) {
+
+    close();
+    std::error_code ec;
+    for (auto& file : std::filesystem::directory_iterator(dir, ec)) {
+        if (file.path().extension() != ".rbtb") continue;
+
+        int fd = ::open(file.path().c_str(), O_RDONLY);
+        if (fd < 0) continue;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TBFileHeader)) {
+            ::close(fd);
+            continue;
+        }
+        void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) continue;
+
+        const TBFileHeader *header = (const TBFileHeader*)mapping;
+        if (memcmp(header->magic, TB_MAGIC, 4) != 0
+            || header->version != TB_FORMAT_VERSION
+            || header->n_entries != material_size(header->material)
+            || sizeof(TBFileHeader) + header->n_entries > (size_t)st.st_size) {
+            munmap(mapping, st.st_size);
+            continue;
+        }
+        madvise(mapping, st.st_size, MADV_RANDOM);
+
+        Table& table = tables[header->material];
+        table.values = (const U8*)mapping + sizeof(TBFileHeader);
+        table.mapping = mapping;
+        table.length = st.st_size;
+        largest = std::max(largest, material_pieces(header->material));
+    }
+
+    return !tables.empty();
+}
+
+void Tablebases::close() {
+    for (auto& table : tables) {
+        if (table.second.mapping != nullptr) {
+            munmap(table.second.mapping, table.second.length);
+        }
+    }
+    tables.clear();
+    largest = 0;
+}
+
+void Tablebases::add(Material m, const U8 *values) {
+    Table& table = tables[m];
+    table.values = values;
+    largest = std::max(largest, material_pieces(m));
+}
+
+bool Tablebases::contains(Material m) const {
+    return m == 0 || tables.count(std::min(m, mirror_material(m)));
+}
+
+int Tablebases::max_pieces() const {
+    return largest;
+}
+
+bool Tablebases::probe(const Board& b, TBResult& result) const {
+
+    if (tables.empty()) return false;
+
+    Material m = board_material(b);
+    if (m == 0) {
+        result = TBResult();
+        return true;
+    }
+    if (material_pieces(m) > largest) return false;
+    if (m > mirror_material(m)) return probe(mirror_board(b), result);
+
+    auto it = tables.find(m);
+    if (it == tables.end()) return false;
+
+    U8 value = it->second.values[tb_board_to_index(b, m)];
+    if (value == TB_ILLEGAL) return false;
+
+    result = tb_decode(value);
+    return true;
+}
+
+U16 Tablebases::best_move(const Board& b, TBResult *result) const {
+
+    TBResult root;
+    if (!probe(b, root)) return 0;
+    if (result) *result = root;
+
+    U16 best = 0;
+    int best_rank = 0;
+    for (U16 m : b.get_sorted_legal_moves()) {
+        Board c = b;
+        c.do_move(m);
+        TBResult child;
+        if (!probe(c, child)) return 0;
+
+        int plies = child.plies + 1;
+        int rank = (child.result < 0 ? 1000 - plies : child.result > 0 ? -1000 + plies : 0);
+        if (best == 0 || rank > best_rank) {
+            best = m;
+            best_rank = rank;
+        }
+    }
+    return best;
+}
+
+bool write_table(const std::string& dir, Material m, const std::vector<U8>& values) {
+
+    std::string path = dir + "/" + material_name(m) + ".rbtb";
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    TBFileHeader header = {};
+    memcpy(header.magic, TB_MAGIC, 4);
+    header.version = TB_FORMAT_VERSION;
+    header.material = m;
+    header.n_entries = values.size();
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(values.data(), 1, values.size(), file) == values.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Endgame tablebases. A table holds every placement of one material
+// signature, e.g. KRvK, with either side to play, as one byte per position:
+// TB_DRAW, TB_ILLEGAL for placements that cannot come up in a game, or else
+// the plies to mate + 1. That makes it even for positions won by the side to
+// play and odd for lost ones: a mate in one is stored as 2, and a side that is
+// already mated as 1.
+//
+// Placements are indexed over the 40 squares of the board as
+//     ((stm * 40 + s[0]) * 40 + s[1]) * 40 + ...
+// with stm 0 for white to play, and the pieces ordered white king, black
+// king, the white rooks, bishops and pawns, then the black ones. Identical
+// pieces are taken in ascending square order and the other orderings are
+// TB_ILLEGAL.
+//
+// Only one of a signature and its mirror image (KvKR for KRvK) has a table:
+// the one with the smaller Material. Positions of the other are probed as
+// their mirror_board.
+//
+// A table file, named after its signature (KRvK.rbtb), is a TBFileHeader
+// followed by the values.
+
+const int TB_SQUARES = 40;
+const uint32_t TB_FORMAT_VERSION = 1;
+
+const U8 TB_DRAW = 0;
+const U8 TB_ILLEGAL = 255;
+const int TB_MAX_PLIES = 252;
+
+struct TBFileHeader {
+    char magic[4];      // "RBTB"
+    uint32_t version;
+    uint32_t material;
+    uint32_t reserved;
+    uint64_t n_entries;
+};
+
+// Piece counts apart from the kings, 3 bits each: white rooks, bishops,
+// pawns, then black rooks, bishops, pawns
+typedef uint32_t Material;
+
+Material board_material(const Board& b);
+int material_pieces(Material m);
+int material_pawns(Material m);
+std::string material_name(Material m);
+size_t material_size(Material m);
+// The signature with the colors swapped
+Material mirror_material(Material m);
+
+// Every signature with at most max_pieces pieces, kings included, that the
+// piece slots of a Board can hold, leaving out the mirror images of others
+std::vector<Material> all_materials(int max_pieces);
+
+// The placement at index, or false if it is not a legal position
+bool tb_index_to_board(Material m, size_t index, Board& b);
+size_t tb_board_to_index(const Board& b, Material m);
+
+struct TBResult {
+    int result = 0;     // for the side to play: 1 won, 0 drawn, -1 lost
+    int plies = 0;      // to mate, when not drawn
+};
+
+TBResult tb_decode(U8 value);
+
+class Tablebases {
+
+    public:
+    ~Tablebases();
+
+    // Maps every table in dir; false if there are none
+    bool open(const std::string& dir);
+    void close();
+
+    // Registers values owned by the caller, for the generator
+    void add(Material m, const U8 *values);
+
+    bool contains(Material m) const;
+    int max_pieces() const;
+
+    bool probe(const Board& b, TBResult& result) const;
+
+    // The move that wins fastest, or draws, or loses slowest; 0 if b or one
+    // of its children is not covered by the tables. result is set to b's.
+    U16 best_move(const Board& b, TBResult *result = nullptr) const;
+
+    private:
+    struct Table {
+        const U8 *values = nullptr;
+        void *mapping = nullptr;
+        size_t length = 0;
+    };
+
+    std::unordered_map<Material, Table> tables;
+    int largest = 0;
+};
+
+bool write_table(const std::string& dir, Material m, const std::vector<U8>& values);
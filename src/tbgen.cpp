@@ -0,0 +1,159 @@
+#include <popl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.hpp"
+#include "tablebase.hpp"
+
+// Endgame tablebase generator. Tables are solved one signature at a time, in
+// the order of all_materials, so the tables a capture or promotion leads to
+// are already done. Within a table, pass n finds the positions that are won
+// or lost in exactly n plies from the results of the passes before it:
+//  - won, if some move leads to a position lost in n - 1
+//  - lost, if every move leads to a position won in at most n - 1, and one
+//    in exactly n - 1
+// Whatever is left when the passes stop changing anything is drawn. Each
+// pass reads the previous pass's values and writes a copy, so the positions
+// can be split between threads freely.
+
+// marks unsolved positions while generating
+const U8 TB_UNKNOWN = 254;
+
+template <typename F>
+void parallel_for(size_t n, int threads, F f) {
+    std::vector<std::thread> workers;
+    size_t chunk = (n + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = t * chunk, end = std::min(n, begin + chunk);
+        workers.emplace_back([=]() {
+            for (size_t i = begin; i < end; i++) f(t, i);
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+int main(int argc, char** argv) {
+
+    popl::OptionParser op("Rollerball endgame tablebase generator");
+    std::string out_dir;
+    int max_pieces, threads;
+    auto help_op = op.add<popl::Switch>("h", "help", "show this help");
+    op.add<popl::Value<std::string>>("o", "out", "directory the tables are written to", "tb", &out_dir);
+    op.add<popl::Value<int>>("n", "pieces", "largest number of pieces, kings included", 4, &max_pieces);
+    op.add<popl::Value<int>>("t", "threads", "threads to solve with", std::thread::hardware_concurrency(), &threads);
+    op.parse(argc, argv);
+
+    if (help_op->is_set()) {
+        std::cout << op << std::endl;
+        return 0;
+    }
+    threads = std::max(threads, 1);
+
+    std::error_code ec;
+    std::filesystem::create_directories(out_dir, ec);
+
+    Tablebases tablebases;
+    std::map<Material, std::vector<U8>> solved;
+
+    for (Material m : all_materials(max_pieces)) {
+
+        auto start_time = std::chrono::steady_clock::now();
+        size_t size = material_size(m);
+        std::vector<U8> values(size), next(size);
+
+        // value of a child for the side to play in it, false if not known yet
+        auto child_value = [&](const Board& c, TBResult& r) {
+            Material cm = board_material(c);
+            if (cm != m) return tablebases.probe(c, r);
+            U8 v = values[tb_board_to_index(c, m)];
+            if (v == TB_UNKNOWN || v == TB_ILLEGAL) return false;
+            r = tb_decode(v);
+            return true;
+        };
+
+        parallel_for(size, threads, [&](int, size_t i) {
+            Board b;
+            if (!tb_index_to_board(m, i, b)) {
+                values[i] = TB_ILLEGAL;
+            } else if (b.get_legal_moves().empty()) {
+                values[i] = b.in_check() ? 1 : TB_DRAW;
+            } else {
+                values[i] = TB_UNKNOWN;
+            }
+        });
+
+        int n = 1;
+        for (; n <= TB_MAX_PLIES; n++) {
+            std::atomic<size_t> changed(0);
+            // longest decisive result of a child of an unsolved position,
+            // per thread
+            std::vector<int> pending(threads, -1);
+            next = values;
+
+            parallel_for(size, threads, [&](int t, size_t i) {
+                if (values[i] != TB_UNKNOWN) return;
+                Board b;
+                tb_index_to_board(m, i, b);
+
+                bool all_won = true;
+                int longest = -1;
+                for (U16 move : b.get_legal_moves()) {
+                    Board c = b;
+                    c.do_move(move);
+                    TBResult r;
+                    if (!child_value(c, r)) {
+                        all_won = false;
+                        continue;
+                    }
+                    if (r.result < 0 && r.plies == n - 1) {
+                        next[i] = n + 1;
+                        changed++;
+                        return;
+                    }
+                    if (r.result <= 0 || r.plies > n - 1) all_won = false;
+                    if (r.result != 0) pending[t] = std::max(pending[t], r.plies);
+                    longest = std::max(longest, r.plies);
+                }
+                if (all_won && longest == n - 1) {
+                    next[i] = n + 1;
+                    changed++;
+                }
+            });
+
+            values.swap(next);
+            // without changes, only children already solved with a longer
+            // result can still decide a position
+            if (changed == 0 && *std::max_element(pending.begin(), pending.end()) < n) break;
+        }
+
+        size_t wins = 0, losses = 0, draws = 0;
+        for (U8& v : values) {
+            if (v == TB_UNKNOWN) v = TB_DRAW;
+            if (v == TB_ILLEGAL) continue;
+            TBResult r = tb_decode(v);
+            (r.result > 0 ? wins : r.result < 0 ? losses : draws)++;
+        }
+
+        if (!write_table(out_dir, m, values)) {
+            std::cout << "ERROR: could not write " << material_name(m) << " to " << out_dir << std::endl;
+            return 1;
+        }
+        solved[m].swap(values);
+        tablebases.add(m, solved[m].data());
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        std::cout << material_name(m) << "  passes " << n << "  won " << wins << "  lost " << losses
+                  << "  drawn " << draws << "  " << seconds << " s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tt.hpp"
+
+const char TT_MAGIC[4] = {'R', 'B', 'T', 'T'};
+const char TT_SHARED_MAGIC[4] = {'R', 'B', 'T', 'S'};
+
+U64 tt_pack(int score, U16 move, int depth, TTBound bound) {
+    return (U64)(uint32_t)score | ((U64)move << 32) | ((U64)(U8)depth << 48) | ((U64)bound << 56);
+}
+
+TTEntry tt_unpack(U64 key, U64 data) {
+    TTEntry e;
+    e.key = key;
+    e.score = (int32_t)(uint32_t)data;
+    e.move = (U16)(data >> 32);
+    e.depth = (U8)(data >> 48);
+    e.bound = (U8)(data >> 56);
+    return e;
+}
+
+#ifdef MAP_HUGETLB
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+const int MAP_HUGE_2MB_FLAG = 21 << MAP_HUGE_SHIFT;
+const int MAP_HUGE_1GB_FLAG = 30 << MAP_HUGE_SHIFT;
+#endif
+
+// Anonymous zeroed memory of at least length bytes, on huge pages if
+// possible; sets length to what was mapped
+void* map_slots(size_t& length) {
+
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // explicit huge pages only exist if the administrator reserved some
+    const size_t sizes[2] = {(size_t)1 << 30, (size_t)2 << 20};
+    const int flags[2] = {MAP_HUGE_1GB_FLAG, MAP_HUGE_2MB_FLAG};
+    for (int i = 0; i < 2 && p == MAP_FAILED; i++) {
+        if (length < sizes[i]) continue;
+        size_t rounded = (length + sizes[i] - 1) & ~(sizes[i] - 1);
+        p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags[i], -1, 0);
+        if (p != MAP_FAILED) length = rounded;
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+        madvise(p, length, MADV_HUGEPAGE);
+#endif
+    }
+    return p;
+}
+
+TranspositionTable::~TranspositionTable() {
+    release();
+}
+
+void TranspositionTable::release() {
+    if (!shared_name.empty()) {
+        TTSharedHeader *header = (TTSharedHeader*)mapping;
+        if (__atomic_sub_fetch(&header->attached, 1, __ATOMIC_ACQ_REL) == 0) {
+            shm_unlink(shared_name.c_str());
+        }
+        shared_name.clear();
+    }
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_length);
+    }
+    slots = nullptr;
+    n_slots = 0;
+    mapping = nullptr;
+    mapping_length = 0;
+}
+
+void TranspositionTable::resize(size_t mb) {
+
+    if (is_shared()) return;
+
+    size_t n = 1;
+    while (2 * n * sizeof(TTSlot) <= mb * 1024 * 1024) {
+        n *= 2;
+    }
+    if (n == n_slots) return;
+
+    release();
+    size_t length = n * sizeof(TTSlot);
+    void *p = map_slots(length);
+    if (p == nullptr) return;
+    slots = (TTSlot*)p;
+    n_slots = n;
+    mapping = p;
+    mapping_length = length;
+}
+
+void TranspositionTable::clear(size_t n_threads) {
+
+    // a slot another process reads half cleared fails its key check
+    auto clear_range = [this](size_t begin, size_t end) {
+        memset((void*)(slots + begin), 0, (end - begin) * sizeof(TTSlot));
+    };
+
+    n_threads = std::max<size_t>(std::min<size_t>(n_threads, n_slots / 4096), 1);
+    std::vector<std::thread> threads;
+    size_t chunk = n_slots / n_threads;
+    for (size_t i = 1; i < n_threads; i++) {
+        threads.emplace_back(clear_range, i * chunk, i + 1 == n_threads ? n_slots : (i + 1) * chunk);
+    }
+    clear_range(0, n_threads > 1 ? chunk : n_slots);
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+size_t TranspositionTable::size() const {
+    return n_slots;
+}
+
+bool TranspositionTable::probe(U64 key, TTEntry& entry) const {
+    if (n_slots == 0) return false;
+    const TTSlot& slot = slots[key & (n_slots - 1)];
+    U64 check = __atomic_load_n(&slot.check, __ATOMIC_RELAXED);
+    U64 data = __atomic_load_n(&slot.data, __ATOMIC_RELAXED);
+    if ((check ^ data) != key) return false;
+    entry = tt_unpack(key, data);
+    return true;
+}
+
+void TranspositionTable::store(U64 key, int score, U16 move, int depth, TTBound bound) {
+    if (n_slots == 0) return;
+    TTSlot& slot = slots[key & (n_slots - 1)];
+    U64 old_check = __atomic_load_n(&slot.check, __ATOMIC_RELAXED);
+    U64 old_data = __atomic_load_n(&slot.data, __ATOMIC_RELAXED);
+    if ((old_check ^ old_data) == key && tt_unpack(key, old_data).depth > depth) return;
+    U64 data = tt_pack(score, move, depth, bound);
+    __atomic_store_n(&slot.check, key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot.data, data, __ATOMIC_RELAXED);
+}
+
+bool TranspositionTable::save(const std::string& path, U64 fingerprint) const {
+
+    // a reader never sees a half written table, and one mapping the old
+    // file keeps it
+    std::string tmp_path = path + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    TTFileHeader header = {};
+    memcpy(header.magic, TT_MAGIC, 4);
+    header.version = TT_FORMAT_VERSION;
+    header.fingerprint = fingerprint;
+    header.n_entries = n_slots;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+              && fwrite(slots, sizeof(TTSlot), n_slots, file) == n_slots;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TranspositionTable::load(const std::string& path, U64 fingerprint) {
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TTFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void *file_mapping = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (file_mapping == MAP_FAILED) return false;
+
+    const TTFileHeader *header = (const TTFileHeader*)file_mapping;
+    U64 n = header->n_entries;
+    if (memcmp(header->magic, TT_MAGIC, 4) != 0
+        || header->version != TT_FORMAT_VERSION
+        || header->fingerprint != fingerprint
+        || n == 0 || (n & (n - 1)) != 0
+        || sizeof(TTFileHeader) + n * sizeof(TTSlot) != (size_t)st.st_size) {
+        munmap(file_mapping, st.st_size);
+        return false;
+    }
+
+    TTSlot *file_slots = (TTSlot*)((char*)file_mapping + sizeof(TTFileHeader));
+    if (!is_shared() && (n == n_slots || n_slots == 0)) {
+        release();
+        slots = file_slots;
+        n_slots = n;
+        mapping = file_mapping;
+        mapping_length = st.st_size;
+        // probes are random, read ahead would only waste memory
+        madvise(mapping, mapping_length, MADV_RANDOM);
+        return true;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const TTSlot& slot = file_slots[i];
+        if (slot.check == 0 && slot.data == 0) continue;
+        TTEntry e = tt_unpack(slot.check ^ slot.data, slot.data);
+        store(e.key, e.score, e.move, e.depth, (TTBound)e.bound);
+    }
+    munmap(file_mapping, st.st_size);
+    return true;
+}
+
+bool TranspositionTable::attach(const std::string& name, size_t mb, U64 fingerprint) {
+
+    size_t n = 1;
+    while (2 * n * sizeof(TTSlot) <= mb * 1024 * 1024) {
+        n *= 2;
+    }
+
+    // exactly one process creates the object and sizes it, which also
+    // zeroes it; the others wait for it to be marked ready
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) return false;
+
+    size_t length = sizeof(TTSharedHeader) + n * sizeof(TTSlot);
+    if (created && ftruncate(fd, length) < 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    struct stat st;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(TTSharedHeader)
+           && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if ((size_t)st.st_size < sizeof(TTSharedHeader)) {
+        ::close(fd);
+        return false;
+    }
+    length = st.st_size;
+
+    void *shared_mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (shared_mapping == MAP_FAILED) {
+        if (created) shm_unlink(name.c_str());
+        return false;
+    }
+
+#ifdef MADV_HUGEPAGE
+    // taken up where shared memory may use transparent huge pages
+    madvise(shared_mapping, length, MADV_HUGEPAGE);
+#endif
+
+    TTSharedHeader *header = (TTSharedHeader*)shared_mapping;
+    if (created) {
+        memcpy(header->magic, TT_SHARED_MAGIC, 4);
+        header->version = TT_FORMAT_VERSION;
+        header->fingerprint = fingerprint;
+        header->n_entries = n;
+        header->attached = 0;
+        __atomic_store_n(&header->ready, 1, __ATOMIC_RELEASE);
+    }
+    while (!__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    U64 shared_n = header->n_entries;
+    if (!__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE)
+        || memcmp(header->magic, TT_SHARED_MAGIC, 4) != 0
+        || header->version != TT_FORMAT_VERSION
+        || header->fingerprint != fingerprint
+        || shared_n == 0 || (shared_n & (shared_n - 1)) != 0
+        || sizeof(TTSharedHeader) + shared_n * sizeof(TTSlot) > length) {
+        munmap(shared_mapping, length);
+        return false;
+    }
+    __atomic_add_fetch(&header->attached, 1, __ATOMIC_ACQ_REL);
+
+    release();
+    slots = (TTSlot*)((char*)shared_mapping + sizeof(TTSharedHeader));
+    n_slots = shared_n;
+    mapping = shared_mapping;
+    mapping_length = length;
+    shared_name = name;
+    return true;
+}
+
+void TranspositionTable::detach() {
+    if (is_shared()) release();
+}
+
+bool TranspositionTable::is_shared() const {
+    return !shared_name.empty();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <cstdint>
+#include <string>
+#pragma pop_macro("move")
+
+#include "board.hpp"
+
+// Transposition table of search results, one entry per slot, indexed by the
+// low bits of the key. Positions are keyed by Board::canonical_hash, so a
+// position and its mirror image share an entry; a stored move is in the
+// orientation of the key and has to be mirrored back when the position was.
+//
+// Slots are read and written without locks, as two words: one packs the
+// entry's data and the other is the key xor that word, so that a slot torn
+// by concurrent stores no longer matches either key. This lets the threads
+// of several processes share one table in POSIX shared memory.
+//
+// Private tables are anonymous mappings on the largest pages the system
+// gives: explicit 1 GB or 2 MB huge pages if some are reserved, else
+// transparent huge pages where enabled. Pages are only placed, on the NUMA
+// node of the thread that first touches them, once a search or a clear
+// reaches them, so they follow the threads that use them.
+//
+// A table can also be saved to a file and loaded back, for a later search
+// to start warm. The file is the magic "RBTT", uint32 version, uint32 zero,
+// uint64 fingerprint and uint64 number of slots, followed by the slots. The
+// fingerprint identifies what the scores were computed with, and neither a
+// file nor a shared table with another one is used.
+
+const uint32_t TT_FORMAT_VERSION = 2;
+
+enum TTBound : U8 {
+    TT_EXACT,
+    TT_LOWER,   // the score is at least this
+    TT_UPPER    // the score is at most this
+};
+
+struct TTEntry {
+    U64 key = 0;
+    int32_t score = 0;
+    U16 move = 0;
+    U8 depth = 0;
+    U8 bound = TT_EXACT;
+};
+
+struct TTSlot {
+    U64 check = 0;
+    U64 data = 0;
+};
+
+static_assert(sizeof(TTSlot) == 16, "TTSlot must stay 16 bytes");
+
+struct TTFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t reserved;
+    U64 fingerprint;
+    U64 n_entries;
+};
+
+// Head of a shared table, followed by its slots from offset 64
+struct TTSharedHeader {
+    char magic[4];
+    uint32_t version;
+    // set by the creator once the rest is written
+    uint32_t ready;
+    // processes attached, the last one to detach removes the object
+    uint32_t attached;
+    U64 fingerprint;
+    U64 n_entries;
+    char reserved[32];
+};
+
+static_assert(sizeof(TTSharedHeader) == 64, "TTSharedHeader must stay 64 bytes");
+
+class TranspositionTable {
+
+    public:
+    TranspositionTable() = default;
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // Sizes the table to the largest power of two entries that fits in mb
+    // megabytes and clears it; keeps the entries if the size is unchanged,
+    // and a shared table always
+    void resize(size_t mb);
+    // Clears the table, for every process if it is shared, splitting the
+    // work between n_threads threads
+    void clear(size_t n_threads = 1);
+    size_t size() const;
+
+    bool probe(U64 key, TTEntry& entry) const;
+    // Replaces the slot's entry unless it is a deeper result for the same key
+    void store(U64 key, int score, U16 move, int depth, TTBound bound);
+
+    // Writes the table to path, through a temporary file that replaces it
+    bool save(const std::string& path, U64 fingerprint) const;
+    // Loads a table saved with the same fingerprint. One of the same size
+    // is mapped copy-on-write and faulted in as it is probed, others, and
+    // any into a shared table, are stored entry by entry.
+    bool load(const std::string& path, U64 fingerprint);
+
+    // Replaces the table with the one in the POSIX shared memory object
+    // name, creating it with mb megabytes if it does not exist yet; its size
+    // is the creator's. Fails if it holds scores of another fingerprint.
+    bool attach(const std::string& name, size_t mb, U64 fingerprint);
+    // Unmaps a shared table, leaving this one empty
+    void detach();
+    bool is_shared() const;
+
+    private:
+    TTSlot *slots = nullptr;
+    size_t n_slots = 0;
+    // anonymous, file or shared memory mapping that holds the slots
+    void *mapping = nullptr;
+    size_t mapping_length = 0;
+    std::string shared_name;
+
+    void release();
+};
@@ -1,61 +1,172 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <iostream>
 #include "uciws.hpp"
 #include "board.hpp"
+#include "workers.hpp"
 
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <thread>
-#include <vector>
-#include <iterator>
 
-template <typename Out>
-void split(const std::string &s, char delim, Out result) {
-    std::istringstream iss(s);
-    std::string item;
-    while (std::getline(iss, item, delim)) {
-        *result++ = item;
+// Splits off the next space separated token of s as a view into the same
+// buffer, so commands are parsed without copying the payload
+std::string_view next_token(std::string_view& s) {
+    size_t start = s.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        s = std::string_view();
+        return s;
     }
+    size_t end = std::min(s.find(' ', start), s.size());
+    auto tok = s.substr(start, end - start);
+    s.remove_prefix(end);
+    return tok;
 }
 
-std::vector<std::string> split(const std::string &s, char delim) {
-    std::vector<std::string> elems;
-    split(s, delim, std::back_inserter(elems));
-    return elems;
+// The integer at the start of tok, or 0 if there is none, without copying it
+// into a string for atoi
+int token_to_int(std::string_view tok) {
+    int value = 0;
+    std::from_chars(tok.data(), tok.data() + tok.size(), value);
+    return value;
 }
 
-UCIWSServer::UCIWSServer(std::string name, uint32_t port) {
+// (length, first character) is a perfect hash over the commands we support;
+// the full comparison in each case rejects everything else
+constexpr uint32_t command_key(std::string_view cmd) {
+    return cmd.empty() ? 0 : ((uint32_t)cmd.size() << 8) | (uint8_t)cmd[0];
+}
+
+UCIWSServer::UCIWSServer(std::string name, uint32_t port, size_t n_search_threads) {
     this->name = name;
     this->port = port;
+    this->n_search_threads = std::max<size_t>(n_search_threads, 1);
 }
 
-void UCIWSServer::handle_message(ClientConnection conn, const std::string& message) {
+void UCIWSServer::handle_message(ClientConnection conn, std::string_view message) {
 
-    auto toks = split(message, ' ');
+    std::string_view args = message;
+    std::string_view cmd = next_token(args);
 
-    if (toks[0] == "uci") {
-        on_uci();
-    }
-    else if (toks[0] == "isready") {
-        on_isready();
+    switch (command_key(cmd)) {
+        case command_key("uci"):
+            if (cmd == "uci") return on_uci(conn);
+            break;
+        case command_key("isready"):
+            if (cmd == "isready") return on_isready(conn);
+            break;
+        case command_key("ucinewgame"):
+            if (cmd == "ucinewgame") return on_ucinewgame(conn);
+            break;
+        case command_key("setoption"):
+            if (cmd == "setoption") return on_setoption(conn, args);
+            break;
+        case command_key("position"):
+            if (cmd == "position") return on_position(conn, args);
+            break;
+        case command_key("go"):
+            if (cmd == "go") return on_go(conn, args);
+            break;
+        case command_key("stop"):
+            if (cmd == "stop") return on_stop(conn);
+            break;
+        case command_key("quit"):
+            if (cmd == "quit") return on_quit();
+            break;
     }
-    else if (toks[0] == "ucinewgame") {
-        on_ucinewgame();
-    }
-    else if (toks[0] == "position") {
-        on_position(toks);
-    }
-    else if (toks[0] == "go") {
-        on_go(toks);
+
+    std::cout << "Unsupported message\n";
+}
+
+std::shared_ptr<GameSession> UCIWSServer::get_session(ClientConnection conn) {
+
+    std::lock_guard<std::mutex> lock(this->sessions_mutex);
+
+    auto& session = this->sessions[conn];
+    if (!session) {
+        session = std::make_shared<GameSession>(this->search_pool);
+        session->e.use_nnue = this->use_nnue;
+        session->e.hash_mb = this->hash_mb;
+        session->e.mate_hash_mb = this->mate_hash_mb;
+        session->e.tablebases = this->tablebases;
+        session->e.workers = this->workers;
+        session->e.backend = this->backend;
+        session->e.mcts.leaf = this->mcts_leaf;
+        session->e.mcts.threads = this->mcts_threads;
+        // a worker's moves are chosen for it
+        if (!this->worker) {
+            session->e.mate_check = this->mate_check;
+            session->e.book = this->book;
+        }
+        if (!this->shared_hash.empty() && !session->e.attach_tt(this->shared_hash)) {
+            std::cout << "Could not attach to " << this->shared_hash << ", using a table of its own\n";
+        }
+        session->table_to_load = !this->hash_file.empty();
+
+        // analysis wants every depth's lines, games only the final one
+        GameSession *s = session.get();
+        session->e.on_depth = [this, conn, s]() {
+            if (s->e.multi_pv <= 1) return;
+            for (size_t i = 0; i < s->e.lines.size(); i++) {
+                server.sendMessage(conn, s->e.uci_info(i));
+            }
+        };
     }
-    else if (toks[0] == "stop") {
-        on_stop();
+    return session;
+}
+
+void UCIWSServer::close_session(ClientConnection conn) {
+
+    std::shared_ptr<GameSession> session;
+    {
+        std::lock_guard<std::mutex> lock(this->sessions_mutex);
+
+        auto it = this->sessions.find(conn);
+        if (it == this->sessions.end()) return;
+        session = it->second;
+        this->sessions.erase(it);
     }
-    else if (toks[0] == "quit") {
-        on_quit();
+
+    // a search still running on the pool keeps its own reference to the
+    // session, and won't reply once stop_requested is left unset
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->e.search = false;
     }
-    else {
-        std::cout << "Unsupported message\n";
+    save_table(session);
+}
+
+void UCIWSServer::save_table(std::shared_ptr<GameSession> session) {
+
+    if (this->hash_file.empty()) return;
+
+    // counted from now, so that a session created meanwhile does not load
+    // the file before this game's table is in it
+    {
+        std::lock_guard<std::mutex> lock(this->hash_file_mutex);
+        this->pending_saves++;
     }
+
+    // off the event loop, as large tables take a while to write, and once
+    // the session's search is over
+    session->strand.post([this, session]() {
+        std::lock_guard<std::mutex> lock(this->hash_file_mutex);
+        if (!session->e.save_tt(this->hash_file)) {
+            std::cout << "Could not save the table to " << this->hash_file << "\n";
+        }
+        this->pending_saves--;
+    });
+}
+
+// On the session's strand; a save that is still pending leaves the load to
+// the next search, rather than waiting for it on the pool
+void UCIWSServer::load_table(GameSession& session) {
+
+    std::lock_guard<std::mutex> lock(this->hash_file_mutex);
+    if (this->pending_saves > 0) return;
+    session.e.load_tt(this->hash_file);
+    session.table_to_load = false;
 }
 
 void UCIWSServer::start() {
@@ -74,6 +185,7 @@ void UCIWSServer::start() {
     {
         main_evt_loop.post([conn, this]()
         {
+            this->close_session(conn);
             std::clog << "Connection closed." << std::endl;
             std::clog << "There are now " << server.numConnections() << " open connections." << std::endl;
         });
@@ -83,6 +195,14 @@ void UCIWSServer::start() {
         this->handle_message(conn, message);
     });
     
+    //Start the search pool shared by all the game sessions
+    asio::io_service::work search_work(search_pool);
+    for (size_t i = 0; i < n_search_threads; i++) {
+        this->search_threads.emplace_back([this]() {
+            search_pool.run();
+        });
+    }
+
     //Start the networking thread
     this->server_thread = std::thread([this]() {
         server.run(port);
@@ -93,72 +213,259 @@ void UCIWSServer::start() {
     main_evt_loop.run();
 }
 
-void UCIWSServer::on_uci() {
+void UCIWSServer::on_uci(ClientConnection conn) {
     std::cout << "In method on_uci\n";
-    server.broadcastMessage("uciok");
+    server.sendMessage(conn, "option name MultiPV type spin default 1 min 1 max " + std::to_string(UCI_MAX_MULTI_PV));
+    server.sendMessage(conn, "uciok");
 }
 
-void UCIWSServer::on_isready() {
+void UCIWSServer::on_isready(ClientConnection conn) {
     std::cout << "In method on_isready\n";
-    server.broadcastMessage("readyok");
+    server.sendMessage(conn, "readyok");
 }
 
-void UCIWSServer::on_ucinewgame() {
+void UCIWSServer::on_ucinewgame(ClientConnection conn) {
     std::cout << "In method on_ucinewgame\n";
-    b = Board();
+    auto session = get_session(conn);
+
+    std::unique_lock<std::mutex> lock(session->mutex);
+    if (session->searching) {
+        // the search finishes with the old session, and the new game gets
+        // a session of its own; options set on the connection outlive games
+        int multi_pv = session->multi_pv;
+        lock.unlock();
+        close_session(conn);
+        auto next = get_session(conn);
+        std::lock_guard<std::mutex> next_lock(next->mutex);
+        next->multi_pv = multi_pv;
+        return;
+    }
+
+    // the session and its table are kept for the next game
+    session->b = Board();
+    session->e.previous_board_occurences.clear();
+    lock.unlock();
+
+    // the tables are saved and cleared on the pool, and a go that arrives
+    // meanwhile is queued behind
+    if (!this->hash_file.empty()) {
+        // a new game would start from the saved table, which is this one
+        save_table(session);
+    }
+    session->strand.post([this, session]() {
+        session->e.mate_solver.clear();
+        if (this->hash_file.empty() && !session->e.tt.is_shared()) {
+            // in parallel, which also spreads the pages touched first over
+            // the NUMA nodes of the threads
+            session->e.tt.clear(this->n_search_threads);
+        }
+    });
 }
 
-void UCIWSServer::on_position(std::vector<std::string>& toks) {
+void UCIWSServer::on_setoption(ClientConnection conn, std::string_view args) {
+    std::cout << "In method on_setoption\n";
+    auto session = get_session(conn);
+
+    // setoption name <id> value <x>, with single word ids
+    std::string_view id, value;
+    for (auto tok = next_token(args); !tok.empty(); tok = next_token(args)) {
+        if (tok == "name") id = next_token(args);
+        else if (tok == "value") value = next_token(args);
+    }
+
+    if (id == "MultiPV") {
+        int multi_pv = std::clamp(token_to_int(value), 1, UCI_MAX_MULTI_PV);
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->multi_pv = multi_pv;
+        return;
+    }
+    std::cout << "Unsupported option\n";
+}
+
+void UCIWSServer::on_position(ClientConnection conn, std::string_view args) {
     std::cout << "In method on_position\n";
-    if (toks.size() > 3) {
-        b.do_move(str_to_move(toks[toks.size()-1]));
+    auto session = get_session(conn);
+
+    // position pieces ... from a coordinator replaces the whole game
+    std::string_view first = args;
+    if (this->worker && next_token(first) == "pieces") {
+        Board b;
+        std::vector<std::string> repeated;
+        if (!str_to_position(args, b, repeated)) {
+            std::cout << "Invalid position\n";
+            return;
+        }
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->b = b;
+        session->e.previous_board_occurences.clear();
+        for (auto& board_str : repeated) {
+            session->e.previous_board_occurences[board_str] = 2;
+        }
+        // find_best_move counts the root once more itself
+        auto root = session->e.previous_board_occurences.find(board_to_str(b.data.board_0));
+        if (root != session->e.previous_board_occurences.end()) {
+            root->second--;
+        }
+        return;
+    }
+
+    // position startpos moves ... <last move>: only the last move is new
+    int n_toks = 1;
+    std::string_view last_tok;
+    for (auto tok = next_token(args); !tok.empty(); tok = next_token(args)) {
+        last_tok = tok;
+        n_toks++;
+    }
+    if (n_toks > 3) {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->b.do_move(str_to_move(last_tok));
     }
 }
 
-void UCIWSServer::on_go(std::vector<std::string>& toks) {
+void UCIWSServer::on_go(ClientConnection conn, std::string_view args) {
     std::cout << "In method on_go\n";
-    // launch a thread to find the best move
-    e.search = true;
-    this->game_thread = std::thread([this]() {
-        e.find_best_move(b);
+    auto session = get_session(conn);
+
+    // go mate N looks for a mate in N moves before searching, and
+    // searchmoves takes the moves up to the next keyword
+    SearchLimits limits;
+    auto is_move = [](std::string_view tok) {
+        return tok.size() >= 4 && tok[0] >= 'a' && tok[0] <= 'g' && isdigit(tok[1]);
+    };
+    auto tok = next_token(args);
+    while (!tok.empty()) {
+        if (tok == "searchmoves") {
+            for (tok = next_token(args); is_move(tok); tok = next_token(args)) {
+                limits.searchmoves.push_back(str_to_move(tok));
+            }
+            continue;
+        }
+        int *value = (tok == "mate" ? &limits.mate : tok == "depth" ? &limits.depth :
+                      tok == "nodes" ? &limits.nodes : tok == "movetime" ? &limits.movetime_ms : nullptr);
+        if (value) {
+            *value = std::max(0, token_to_int(next_token(args)));
+        }
+        tok = next_token(args);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->e.limits = limits;
+        session->e.multi_pv = session->multi_pv;
+        session->searching = true;
+        session->stop_requested = false;
+        session->e.best_move = 0;
+        session->e.search = true;
+    }
+
+    // queue the search on the shared pool
+    session->strand.post([this, conn, session]() {
+        if (session->table_to_load) {
+            load_table(*session);
+        }
+        if (session->e.search) {
+            session->e.find_best_move(session->b);
+        }
+
+        bool reply;
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            session->searching = false;
+            // a coordinator waits for every search to end by itself
+            reply = session->stop_requested || this->worker;
+        }
+        if (reply) {
+            send_bestmove(conn, *session);
+        }
     });
 }
 
-void UCIWSServer::on_stop() {
+void UCIWSServer::on_stop(ClientConnection conn) {
     std::cout << "In method on_stop\n";
-    e.search = false;
-    this->game_thread.join();
-    U16 move = e.best_move;
+    auto session = get_session(conn);
+
+    bool reply;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->e.search = false;
+        session->stop_requested = true;
+        // the bestmove of a worker's search was already sent when it ended
+        reply = !session->searching && !this->worker;
+    }
+    if (reply) {
+        send_bestmove(conn, *session);
+    }
+}
 
-    // move checking
-    auto legal_moves = b.get_legal_moves();
+void UCIWSServer::send_bestmove(ClientConnection conn, GameSession& session) {
 
-    assert(legal_moves.size() > 0);
-    assert(legal_moves.count(move) > 0);
-    b.do_move(move);
+    U16 move = session.e.best_move;
+    std::string str_move;
+    {
+        // position is handled on the event loop, and also moves the board
+        std::lock_guard<std::mutex> lock(session.mutex);
+        Board& b = session.b;
+
+        // move checking
+        auto legal_moves = b.get_sorted_legal_moves();
 
-    auto str_move = move_to_str(move);
-    auto opp_moves = b.get_legal_moves();
-    if (b.in_check()) { // opponent is in check because of our move
-        if (opp_moves.size() > 0) {
-            // check
-            str_move += '+';
+        assert(legal_moves.size() > 0);
+        if (!std::binary_search(legal_moves.begin(), legal_moves.end(), move)) {
+            // the search was stopped before it got off the queue
+            move = legal_moves.front();
         }
-        else {
-            // checkmate
-            str_move += '#';
+        b.do_move(move);
+
+        str_move = move_to_str(move);
+        auto opp_moves = b.get_legal_moves();
+        if (b.in_check()) { // opponent is in check because of our move
+            if (opp_moves.size() > 0) {
+                // check
+                str_move += '+';
+            }
+            else {
+                // checkmate
+                str_move += '#';
+            }
+        }
+        else if (opp_moves.size() == 0) {
+            // stalemate
+            str_move += '-';
         }
     }
-    else if (opp_moves.size() == 0) {
-        // stalemate
-        str_move += '-';
+
+    if (this->stats_log.is_open()) {
+        std::lock_guard<std::mutex> lock(this->stats_mutex);
+        this->stats_log << session.e.stats_json() << std::endl;
     }
 
-    server.broadcastMessage("bestmove " + move_to_str(move));
+    for (size_t i = 0; i < std::max<size_t>(session.e.lines.size(), 1); i++) {
+        server.sendMessage(conn, session.e.uci_info(i));
+    }
+    server.sendMessage(conn, "bestmove " + move_to_str(move));
 }
 
 void UCIWSServer::on_quit() {
     std::cout << "In method on_quit\n";
+
+    // games still open would all overwrite the same file, so one table is
+    // enough; it is saved on its session's strand, once nothing else uses
+    // it, and the process exits from there
+    if (!this->hash_file.empty()) {
+        std::lock_guard<std::mutex> lock(this->sessions_mutex);
+        if (!this->sessions.empty()) {
+            auto session = this->sessions.begin()->second;
+            {
+                std::lock_guard<std::mutex> session_lock(session->mutex);
+                session->e.search = false;
+            }
+            session->strand.post([this, session]() {
+                std::lock_guard<std::mutex> file_lock(this->hash_file_mutex);
+                session->e.save_tt(this->hash_file);
+                std::exit(0);
+            });
+            return;
+        }
+    }
     std::exit(0);
 }
-
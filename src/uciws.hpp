@@ -1,43 +1,123 @@
 #pragma once
 
 #include <csignal>
+#include <fstream>
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <asio/io_service.hpp>
+#include <asio/io_service_strand.hpp>
 
 #include "server.hpp"
 #include "board.hpp"
 #include "engine.hpp"
 
+// upper bound of the MultiPV option, as every line costs a root search
+const int UCI_MAX_MULTI_PV = 16;
+
+// State of one game, owned by the connection that is playing it
+struct GameSession {
+
+    Board b;
+    Engine e;
+
+    // everything done with e on the search pool, its searches and the saves,
+    // clears and load of its table, runs through this, one thing at a time
+    // and in the order it was queued
+    asio::io_service::strand strand;
+    // the table in hash_file is still to be loaded, which the first search
+    // to find no save to it pending does
+    bool table_to_load = false;
+
+    explicit GameSession(asio::io_service& search_pool): strand(search_pool) {}
+
+    // `stop` can arrive before the pool gets round to running the search, so
+    // bestmove is sent by whichever of the two finishes last
+    std::mutex mutex;
+    bool searching = false;
+    bool stop_requested = false;
+    // the MultiPV option, which the search only reads from e once the next
+    // go hands it over
+    int multi_pv = 1;
+};
+
 class UCIWSServer {
 
     public:
 
     asio::io_service main_evt_loop;
     WebsocketServer server;
+
+    // searches of every session are run on this shared pool
+    asio::io_service search_pool;
+    std::vector<std::thread> search_threads;
+    size_t n_search_threads;
+
+    // new sessions evaluate with the loaded network
+    bool use_nnue = false;
+    // and get transposition tables of this size
+    size_t hash_mb = 16;
+    // and share the table in this POSIX shared memory object, if set
+    std::string shared_hash;
+    // and load the table saved in this file, if set, saving theirs back to
+    // it when their game ends
+    std::string hash_file;
+    std::mutex hash_file_mutex;
+    // saves to hash_file that are queued but not written yet
+    int pending_saves = 0;
+    // and check for mates in this many moves before searching, with mate
+    // solver tables of this size
+    int mate_check = 0;
+    size_t mate_hash_mb = 4;
+    // and play from this book, if it is open
+    const OpeningBook* book = nullptr;
+    // and probe these tablebases, if any were found
+    const Tablebases* tablebases = nullptr;
+    // and search with this backend, MCTS growing its tree on mcts_threads
+    SearchBackend backend = SEARCH_ALPHA_BETA;
+    MctsLeaf mcts_leaf = MCTS_EVAL;
+    int mcts_threads = 1;
+    // and search their root moves on these, if any are connected
+    RootSplitter* workers = nullptr;
+
+    // as a worker, searches are only ever started by a coordinator's
+    // WorkerPool, which sends whole positions and wants every bestmove
+    bool worker = false;
+
+    // if open, every search's statistics are appended as a JSON line
+    std::ofstream stats_log;
+    std::mutex stats_mutex;
     
     std::thread server_thread;
-    std::thread game_thread;
     std::atomic<bool> running;
 
     uint32_t port;
     std::string name;
 
-    Board b;
-    Engine e;
+    std::map<ClientConnection, std::shared_ptr<GameSession>, std::owner_less<ClientConnection>> sessions;
+    std::mutex sessions_mutex;
 
-    UCIWSServer(std::string name, uint32_t port);
+    UCIWSServer(std::string name, uint32_t port, size_t n_search_threads = 1);
 
     void start();
     void stop();
 
-    void handle_message(ClientConnection conn, const std::string& message);
+    void handle_message(ClientConnection conn, std::string_view message);
+
+    std::shared_ptr<GameSession> get_session(ClientConnection conn);
+    void close_session(ClientConnection conn);
+    void send_bestmove(ClientConnection conn, GameSession& session);
+    void save_table(std::shared_ptr<GameSession> session);
+    void load_table(GameSession& session);
 
-    void on_uci();
-    void on_isready();
-    void on_ucinewgame();
-    void on_position(std::vector<std::string>& toks);
-    void on_go(std::vector<std::string>& toks);
-    void on_stop();
+    void on_uci(ClientConnection conn);
+    void on_isready(ClientConnection conn);
+    void on_ucinewgame(ClientConnection conn);
+    void on_setoption(ClientConnection conn, std::string_view args);
+    void on_position(ClientConnection conn, std::string_view args);
+    void on_go(ClientConnection conn, std::string_view args);
+    void on_stop(ClientConnection conn);
     void on_quit();
 };
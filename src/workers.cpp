@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <sstream>
+
+#include "workers.hpp"
+
+std::string position_to_str(const Board& b, const std::vector<std::string>& repeated) {
+
+    const U8 *positions = (const U8*)(&(b.data));
+    std::string hex;
+    char byte[3];
+    for (int i = 0; i < 24; i++) {
+        U8 value = (i < 12 ? positions[i] : positions[i - 12] == DEAD ? 0 : b.data.board_0[positions[i - 12]]);
+        snprintf(byte, sizeof(byte), "%02x", value);
+        hex += byte;
+    }
+
+    std::string str = "pieces " + hex + (b.data.player_to_play == WHITE ? " w" : " b");
+    if (!repeated.empty()) {
+        str += " repeated";
+        for (auto board_str : repeated) {
+            std::replace(board_str.begin(), board_str.end(), '\n', '/');
+            std::replace(board_str.begin(), board_str.end(), ' ', '_');
+            str += ' ' + board_str;
+        }
+    }
+    return str;
+}
+
+bool str_to_position(std::string_view args, Board& b, std::vector<std::string>& repeated) {
+
+    std::istringstream in{std::string(args)};
+    std::string pieces, hex, player, tok;
+    if (!(in >> pieces >> hex >> player) || pieces != "pieces" || hex.size() != 48 || (player != "w" && player != "b")) {
+        return false;
+    }
+
+    U8 values[24];
+    for (int i = 0; i < 24; i++) {
+        unsigned int value;
+        if (sscanf(hex.c_str() + 2 * i, "%2x", &value) != 1) return false;
+        values[i] = value;
+    }
+    for (int i = 0; i < 12; i++) {
+        if (values[i] != DEAD && (getx(values[i]) > 6 || gety(values[i]) > 6)) return false;
+    }
+
+    repeated.clear();
+    if (in >> tok) {
+        if (tok != "repeated") return false;
+        while (in >> tok) {
+            std::replace(tok.begin(), tok.end(), '/', '\n');
+            std::replace(tok.begin(), tok.end(), '_', ' ');
+            repeated.push_back(tok);
+        }
+    }
+
+    b = board_from_pieces(values, values + 12, player == "w" ? WHITE : BLACK);
+    return true;
+}
+
+WorkerPool::~WorkerPool() {
+    if (client_thread.joinable()) {
+        client.stop();
+        client_thread.join();
+    }
+}
+
+bool WorkerPool::connect(const std::vector<std::string>& uris) {
+
+    if (!client_thread.joinable()) {
+        client.connect([this](ServerConnection conn) { on_open(conn); });
+        client.disconnect([this](ServerConnection conn) { on_close(conn); });
+        client.message([this](ServerConnection conn, const std::string& message) { on_message(conn, message); });
+    }
+
+    for (auto& uri : uris) {
+        if (!client.open(uri)) return false;
+    }
+
+    if (!client_thread.joinable()) {
+        client_thread = std::thread([this]() {
+            client.run();
+        });
+    }
+    return true;
+}
+
+size_t WorkerPool::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return workers.size();
+}
+
+bool WorkerPool::available() {
+    return size() > 0;
+}
+
+void WorkerPool::on_open(ServerConnection conn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    workers[conn] = Worker();
+    cv.notify_all();
+}
+
+void WorkerPool::on_close(ServerConnection conn) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = workers.find(conn);
+    if (it == workers.end()) return;
+
+    // its move goes to the next idle worker
+    Worker& w = it->second;
+    if (w.busy && !w.stopped && w.search_id == current_id && results != nullptr) {
+        pending.push_front(w.task);
+    }
+    workers.erase(it);
+    cv.notify_all();
+}
+
+void WorkerPool::on_message(ServerConnection conn, const std::string& message) {
+
+    std::istringstream in(message);
+    std::string cmd, tok;
+    in >> cmd;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = workers.find(conn);
+    if (it == workers.end() || !it->second.busy) return;
+    Worker& w = it->second;
+
+    if (cmd == "info") {
+        // the last info line before bestmove is the final one
+        RootResult& r = w.result;
+        while (in >> tok) {
+            if (tok == "score") {
+                std::string kind;
+                int value = 0;
+                in >> kind >> value;
+                r.score = (kind == "mate" ? (value > 0 ? INT_MAX : INT_MIN) : value);
+            } else if (tok == "nodes") {
+                in >> r.nodes;
+            } else if (tok == "pv") {
+                r.pv.clear();
+                while (in >> tok && tok != "string") {
+                    r.pv.push_back(str_to_move(tok));
+                }
+            }
+        }
+    } else if (cmd == "bestmove") {
+        in >> tok;
+        w.busy = false;
+        if (w.search_id == current_id && results != nullptr) {
+            RootResult& r = (*results)[w.task];
+            r.nodes += w.result.nodes;
+            if (!w.stopped) {
+                // with searchmoves the task's move is the only one it can
+                // play, unless the worker did not search
+                if (str_to_move(tok) == moves[w.task]) {
+                    r.done = true;
+                    r.score = w.result.score;
+                    r.pv = w.result.pv;
+                    n_done++;
+                } else {
+                    failed = true;
+                }
+            }
+        }
+        cv.notify_all();
+    }
+}
+
+bool WorkerPool::search(const Board& b, const std::vector<std::string>& repeated, const std::vector<U16>& moves,
+                        int depth, const std::function<bool()>& keep_searching, std::vector<RootResult>& results) {
+
+    // another game's search can hold the workers for a whole depth, longer
+    // than this one may have left, so it searches this depth itself instead
+    std::unique_lock<std::mutex> search_lock(search_mutex, std::try_to_lock);
+    if (!search_lock.owns_lock()) {
+        results.clear();
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+
+    current_id++;
+    this->position = "position " + position_to_str(b, repeated);
+    this->depth = depth;
+    this->moves = moves;
+    results.assign(moves.size(), RootResult());
+    this->results = &results;
+    pending.clear();
+    for (size_t i = 0; i < moves.size(); i++) {
+        pending.push_back(i);
+    }
+    n_done = 0;
+    failed = false;
+
+    while (n_done < moves.size() && !failed && keep_searching()) {
+        for (auto& it : workers) {
+            if (pending.empty()) break;
+            Worker& w = it.second;
+            if (w.busy) continue;
+
+            w = Worker();
+            w.busy = true;
+            w.search_id = current_id;
+            w.task = pending.front();
+            pending.pop_front();
+            std::string go = "go depth " + std::to_string(depth) + " searchmoves " + move_to_str(moves[w.task]);
+            if (!client.sendMessage(it.first, this->position) || !client.sendMessage(it.first, go)) {
+                // it is closing, and on_close will remove it
+                w.busy = false;
+                pending.push_front(w.task);
+            }
+        }
+        if (workers.empty()) break;
+        cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    bool done = (n_done == moves.size() && !failed);
+    if (!done) {
+        // the rest of the depth is thrown away, but the nodes searched so far
+        // are still counted
+        for (auto& it : workers) {
+            Worker& w = it.second;
+            if (w.busy && w.search_id == current_id && !w.stopped) {
+                w.stopped = true;
+                client.sendMessage(it.first, "stop");
+            }
+        }
+        cv.wait_for(lock, std::chrono::milliseconds(WORKER_STOP_TIMEOUT_MS), [this]() {
+            return std::none_of(workers.begin(), workers.end(), [this](const auto& it) {
+                return it.second.busy && it.second.search_id == current_id;
+            });
+        });
+    }
+
+    this->results = nullptr;
+    return done;
+}
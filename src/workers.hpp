@@ -0,0 +1,91 @@
+#pragma once
+
+#pragma push_macro("move")
+#undef move
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// websocketpp and asio use std::move too
+#include "client.hpp"
+#pragma pop_macro("move")
+
+#include "board.hpp"
+#include "engine.hpp"
+
+// How long a stopped search waits for the workers' bestmoves before it
+// leaves them to finish on their own
+const int WORKER_STOP_TIMEOUT_MS = 1000;
+
+// Arguments of the position command sent to workers: "pieces", the 12 piece
+// squares and then the pieces on them as hex bytes, w or b, and then after
+// "repeated" every position that already occurred twice, as board_to_str
+// with '\n' and ' ' written as '/' and '_'
+std::string position_to_str(const Board& b, const std::vector<std::string>& repeated);
+bool str_to_position(std::string_view args, Board& b, std::vector<std::string>& repeated);
+
+// Root moves searched on other rollerball processes, started with --worker,
+// over their websocket servers. Every move is a task of its own, given to
+// whichever worker is idle next, so a worker that finishes early takes over
+// the moves left to the others. A depth is done once all of them are.
+class WorkerPool : public RootSplitter {
+
+    public:
+
+    ~WorkerPool();
+
+    // Connects to every ws:// URI, a URI given n times getting n
+    // connections; returns false if one of them is malformed. Workers that
+    // connect later join the search in progress.
+    bool connect(const std::vector<std::string>& uris);
+
+    size_t size();
+
+    bool available() override;
+    bool search(const Board& b, const std::vector<std::string>& repeated, const std::vector<U16>& moves,
+                int depth, const std::function<bool()>& keep_searching, std::vector<RootResult>& results) override;
+
+    private:
+
+    struct Worker {
+        bool busy = false;
+        // the search and move of the task it is busy with
+        int search_id = 0;
+        size_t task = 0;
+        bool stopped = false;
+        RootResult result;
+    };
+
+    void on_open(ServerConnection conn);
+    void on_close(ServerConnection conn);
+    void on_message(ServerConnection conn, const std::string& message);
+
+    WebsocketClient client;
+    std::thread client_thread;
+
+    // one search at a time, as they share the workers; the others search
+    // locally meanwhile
+    std::mutex search_mutex;
+
+    // everything below is guarded by mutex, and cv is notified whenever a
+    // worker connects, disconnects or finishes a task
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<ServerConnection, Worker, std::owner_less<ServerConnection>> workers;
+
+    // the search in progress, if search_id is current_id
+    int current_id = 0;
+    std::string position;
+    int depth = 0;
+    std::vector<U16> moves;
+    std::vector<RootResult>* results = nullptr;
+    std::deque<size_t> pending;
+    size_t n_done = 0;
+    bool failed = false;
+};